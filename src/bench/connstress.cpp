@@ -0,0 +1,62 @@
+#include "../inet/tcp/tcpserver.hpp"
+#include "../inet/tls/tlsclient.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace inet;
+
+// Connects/sec on loopback for a growing number of threads, every connect uses a fresh client. Each iteration also
+// creates and destroys a tls::client, so the shared OpenSSL state is exercised from every thread.
+//
+// usage: connstress [connects per thread] [max threads] [port]
+int main(int argc, char *argv[])
+{
+	unsigned int count = argc > 1 ? std::atoi(argv[1]) : 2000;
+	unsigned int maxthreads = argc > 2 ? std::atoi(argv[2]) : std::max(std::thread::hardware_concurrency(), 1u);
+	std::string port = argc > 3 ? argv[3] : "18081";
+
+	// The server answers every connection with a single byte and closes it
+	tcp::server server;
+	server.start("127.0.0.1", port, std::max(maxthreads, 1u), [](tcp::client& c) {
+		c.put('x');
+		c.flush();
+	}, 4096);
+
+	std::printf("%8s %10s %12s %10s\n", "threads", "connects", "connects/s", "failed");
+	for (unsigned int threads = 1; threads <= maxthreads; threads *= 2) {
+		std::atomic<unsigned int> ok = 0, failed = 0;
+		std::vector<std::thread> workers;
+		auto begin = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < threads; i++) {
+			workers.emplace_back([&] {
+				for (unsigned int n = 0; n < count; n++) {
+					try {
+						tls::client unused;
+						tcp::client c;
+						c.open("127.0.0.1", port);
+						if (c.is_open() && c.get() == 'x')
+							ok++;
+						else
+							failed++;
+					}
+					catch (const std::exception&) {
+						failed++;
+					}
+				}
+			});
+		}
+		for (auto& w : workers)
+			w.join();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-begin;
+		std::printf("%8u %10u %12.0f %10u\n", threads, ok.load(), ok/elapsed.count(), failed.load());
+	}
+
+	server.stop();
+	return 0;
+}
\ No newline at end of file
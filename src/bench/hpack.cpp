@@ -0,0 +1,58 @@
+#include "../inet/http/hpack.hpp"
+#include "../test/rfc7541.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace inet::http;
+
+// Encoding and decoding the header block sequences of RFC 7541 Appendix C, every round starts with fresh tables so
+// the blocks refer to the same entries as in the RFC
+//
+// usage: hpack [rounds]
+int main(int argc, char *argv[])
+{
+	unsigned int rounds = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+	std::printf("%-6s %8s %14s %10s %14s\n", "", "huffman", "decode ns/blk", "MB/s", "encode ns/blk");
+	for (auto& ex : test::rfc7541::examples()) {
+		if (ex.blocks.size() < 2)
+			continue;
+		std::vector<std::string> wires;
+		size_t bytes = 0;
+		for (auto& b : ex.blocks) {
+			wires.push_back(test::rfc7541::unhex(b.hex));
+			bytes += wires.back().size();
+		}
+
+		hpack::fieldlist fields;
+		auto begin = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < rounds; i++) {
+			hpack::decoder d(ex.tablemax);
+			for (auto& w : wires) {
+				fields.clear();
+				d.decode(reinterpret_cast<const uint8_t*>(w.data()), w.size(), fields);
+			}
+		}
+		std::chrono::duration<double, std::nano> decode = std::chrono::steady_clock::now()-begin;
+
+		std::string block;
+		begin = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < rounds; i++) {
+			hpack::encoder e(ex.tablemax);
+			test::rfc7541::configure(e, ex);
+			for (auto& b : ex.blocks) {
+				block.clear();
+				e.encode(b.fields, block);
+			}
+		}
+		std::chrono::duration<double, std::nano> encode = std::chrono::steady_clock::now()-begin;
+
+		auto blocks = static_cast<double>(rounds)*ex.blocks.size();
+		std::printf("%-6s %8s %14.1f %10.1f %14.1f\n", ex.name, ex.huffman ? "yes" : "no", decode.count()/blocks,
+			bytes*static_cast<double>(rounds)*1000/decode.count(), encode.count()/blocks);
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "../inet/runtime/runtime.hpp"
+#include "../inet/tcp/tcpserver.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <thread>
+
+using namespace inet;
+
+// Round trips/sec on loopback for a growing number of shards, every shard owns one client that resolves through the
+// shard's dnscache and talks to its own tcp::server worker
+//
+// usage: runtimescale [round trips per shard] [max shards] [port]
+int main(int argc, char *argv[])
+{
+	unsigned int count = argc > 1 ? std::atoi(argv[1]) : 20000;
+	unsigned int maxshards = argc > 2 ? std::atoi(argv[2]) : std::max(std::thread::hardware_concurrency(), 1u);
+	std::string port = argc > 3 ? argv[3] : "18082";
+
+	// A worker serves one connection at a time, so there is one for every shard
+	tcp::server server;
+	server.start("localhost", port, std::max(maxshards, 1u), [](tcp::client& c) {
+		std::string line;
+		while (std::getline(c, line)) {
+			c << line << '\n';
+			c.flush();
+		}
+	});
+
+	std::printf("%8s %10s %12s %10s\n", "shards", "trips", "trips/s", "failed");
+	for (unsigned int shards = 1; shards <= maxshards; shards *= 2) {
+		runtime rt(shards);
+		std::atomic<unsigned int> ok = 0, failed = 0, left = shards;
+		std::promise<void> done;
+		auto begin = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < shards; i++) {
+			rt.post(i, [&] {
+				try {
+					tcp::client c;
+					c.setdnscache(&runtime::current()->dns());
+					c.open("localhost", port);
+					std::string line;
+					for (unsigned int n = 0; n < count; n++) {
+						c << "ping\n" << std::flush;
+						if (std::getline(c, line) && line == "ping")
+							ok++;
+						else
+							failed++;
+					}
+				}
+				catch (const std::exception&) {
+					failed++;
+				}
+				if (--left == 0)
+					done.set_value();
+			});
+		}
+		done.get_future().wait();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-begin;
+		std::printf("%8u %10u %12.0f %10u\n", shards, ok.load(), ok/elapsed.count(), failed.load());
+	}
+
+	server.stop();
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "../inet/tls/tlsclient.hpp"
+#include "../test/tlsserver.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace inet;
+
+// Handshakes/sec and handshake latency of tls::client against an in-process OpenSSL server on loopback, for every
+// cipher in the default lists of tls::context::options, with TLS 1.2 and 1.3, full and resumed. Every connection
+// sends a one byte request and waits for the one byte response, hs/s counts the whole exchange. With "nodelay" the
+// clients set TCP_NODELAY, without it the request after a resumed TLS 1.2 handshake waits for the delayed ack of the
+// client's Finished.
+//
+// usage: tlsbench [connects per row] [nodelay]
+
+static std::vector<std::string> split(const std::string& list)
+{
+	std::vector<std::string> ret;
+	std::istringstream in(list);
+	std::string item;
+	while (std::getline(in, item, ':'))
+		ret.push_back(item);
+	return ret;
+}
+
+static void measure(int version, const std::string& cipher, bool resume, unsigned int count, bool nodelay)
+{
+	// The server only agrees to this cipher and version, so it's what every handshake negotiates
+	test::tlsserver::options sopt;
+	sopt.minversion = sopt.maxversion = version;
+	(version == TLS1_3_VERSION ? sopt.ciphersuites : sopt.ciphers) = cipher;
+	test::tlsserver server([](SSL *ssl, std::string_view) {
+		char request;
+		SSL_read(ssl, &request, 1);
+		SSL_write(ssl, "x", 1);
+		SSL_shutdown(ssl);
+	}, sopt);
+
+	tls::context::options copt;
+	copt.systemroots = false;
+	copt.capem = server.ca();
+	if (!resume)
+		copt.sessioncapacity = 0;
+	auto ctx = tls::context::create(copt);
+
+	// The first connection of a resumed row fills the cache and isn't counted
+	if (resume) {
+		tls::client c(ctx);
+		c.set_nodelay(nodelay);
+		c.open("localhost", server.port());
+		c.put('x').flush();
+		c.get();
+		c.close();
+	}
+
+	std::vector<double> latency(count);
+	std::string negotiated;
+	auto begin = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < count; i++) {
+		tls::client c(ctx);
+		c.set_nodelay(nodelay);
+		c.open("localhost", server.port());
+		latency[i] = static_cast<double>(c.handshake_time().count());
+		negotiated = c.getcipher();
+
+		// A one byte request and response, TLS 1.3 tickets only arrive with the first read
+		c.put('x').flush();
+		c.get();
+		c.close();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-begin;
+	std::sort(latency.begin(), latency.end());
+	std::printf("%-8s %-30s %-8s %8.0f %9.0f %9.0f %9.0f %8llu\n", version == TLS1_3_VERSION ? "TLS 1.3" : "TLS 1.2",
+		negotiated.c_str(), resume ? "resumed" : "full", count/elapsed.count(), latency[count/2], latency[count*99/100],
+		latency[count*999/1000], static_cast<unsigned long long>(server.resumed()-(resume ? 1 : 0)));
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int count = argc > 1 ? std::atoi(argv[1]) : 1000;
+	bool nodelay = argc > 2 && std::string(argv[2]) == "nodelay";
+
+	tls::context::options defaults;
+	std::printf("%-8s %-30s %-8s %8s %9s %9s %9s %8s\n", "", "cipher", "", "hs/s", "p50 us", "p99 us", "p999 us", "resumed");
+	for (auto& cipher : split(defaults.ciphers)) {
+		measure(TLS1_2_VERSION, cipher, false, count, nodelay);
+		measure(TLS1_2_VERSION, cipher, true, count, nodelay);
+	}
+	for (auto& cipher : split(defaults.ciphersuites)) {
+		measure(TLS1_3_VERSION, cipher, false, count, nodelay);
+		measure(TLS1_3_VERSION, cipher, true, count, nodelay);
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "../inet/tls/tlsclient.hpp"
+#include "../test/tlsserver.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace inet;
+
+// Time to first byte of a small GET over fresh TLS 1.3 connections to an in-process OpenSSL server on loopback: full
+// handshakes, resumed ones, and resumed ones that send the request as early data (0-RTT)
+//
+// usage: ttfb [requests per mode]
+
+static void measure(const char *name, test::tlsserver& server, std::shared_ptr<tls::context> ctx, bool resume, bool early,
+	unsigned int count)
+{
+	std::vector<double> ttfb(count), handshake(count);
+	unsigned int accepted = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		if (!resume)
+			ctx->sessions()->clear();
+		auto start = std::chrono::steady_clock::now();
+		tls::client c(ctx);
+		c.enable_early_data(early);
+		c.open("localhost", server.port());
+		c << "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n" << std::flush;
+		c.get();
+		ttfb[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now()-start).count();
+		handshake[i] = static_cast<double>(c.handshake_time().count());
+		accepted += c.early_data_accepted();
+
+		// Reads the rest, so the next session ticket has arrived
+		std::string rest;
+		std::getline(c, rest, '\0');
+		c.close();
+	}
+	std::sort(ttfb.begin(), ttfb.end());
+	std::sort(handshake.begin(), handshake.end());
+	std::printf("%-10s %9.1f %9.1f %9.1f %12.1f %8u\n", name, ttfb[count/2], ttfb[count*99/100], ttfb[count*999/1000],
+		handshake[count/2], accepted);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int count = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+	test::tlsserver::options opt;
+	opt.minversion = TLS1_3_VERSION;
+	opt.earlydata = 16*1024;
+	test::tlsserver server([](SSL *ssl, std::string_view early) {
+		std::string request(early);
+		char buffer[4096];
+		int n;
+		while (request.find("\r\n\r\n") == std::string::npos && (n = SSL_read(ssl, buffer, sizeof(buffer))) > 0)
+			request.append(buffer, n);
+		const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+		SSL_write(ssl, response, sizeof(response)-1);
+		SSL_shutdown(ssl);
+	}, opt);
+
+	tls::context::options copt;
+	copt.systemroots = false;
+	copt.capem = server.ca();
+	auto ctx = tls::context::create(copt);
+
+	// The last full handshake leaves a session behind for the resumed modes
+	std::printf("%-10s %9s %9s %9s %12s %8s\n", "", "p50 us", "p99 us", "p999 us", "handshake us", "0-rtt");
+	measure("full", server, ctx, false, false, count);
+	measure("resumed", server, ctx, true, false, count);
+	measure("0-rtt", server, ctx, true, true, count);
+	return 0;
+}
\ No newline at end of file
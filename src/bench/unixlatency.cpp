@@ -0,0 +1,102 @@
+#include "../inet/unix/unixclient.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+using namespace inet;
+
+// Round trip latency of unix::client against tcp::client over loopback, both talk to a plain echo server so only
+// the transport differs
+//
+// usage: unixlatency [round trips per size]
+
+static void echo(int listener)
+{
+	int s = accept(listener, nullptr, nullptr);
+	int one = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	char buffer[64*1024];
+	ssize_t n;
+	while ((n = recv(s, buffer, sizeof(buffer), 0)) > 0) {
+		for (ssize_t out = 0; out < n; ) {
+			auto ret = send(s, buffer+out, n-out, MSG_NOSIGNAL);
+			if (ret <= 0)
+				break;
+			out += ret;
+		}
+	}
+	close(s);
+}
+
+static void measure(const char *name, tcp::client& c, size_t size, unsigned int count)
+{
+	std::string message(size, 'x');
+	std::vector<char> reply(size);
+	std::vector<double> rtt(count);
+	auto begin = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < count; i++) {
+		auto start = std::chrono::steady_clock::now();
+		c.write(message.data(), message.size());
+		c.flush();
+		c.read(reply.data(), reply.size());
+		rtt[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now()-start).count();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-begin;
+	std::sort(rtt.begin(), rtt.end());
+	std::printf("%-6s %7zu %10.0f %9.1f %9.1f %9.1f\n", name, size, count/elapsed.count(), rtt[count/2], rtt[count*99/100],
+		rtt[count*999/1000]);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int count = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+	// Loopback TCP on an ephemeral port
+	int tcplistener = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in in = {};
+	in.sin_family = AF_INET;
+	in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(in);
+	bind(tcplistener, reinterpret_cast<sockaddr*>(&in), sizeof(in));
+	listen(tcplistener, 1);
+	getsockname(tcplistener, reinterpret_cast<sockaddr*>(&in), &len);
+
+	// Unix socket in the abstract namespace, so nothing is left behind
+	std::string path = "@inet-unixlatency-" + std::to_string(getpid());
+	int unixlistener = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un un = {};
+	un.sun_family = AF_UNIX;
+	std::copy(path.begin()+1, path.end(), un.sun_path+1);
+	bind(unixlistener, reinterpret_cast<sockaddr*>(&un), offsetof(sockaddr_un, sun_path)+path.size());
+	listen(unixlistener, 1);
+
+	std::thread tcpserver(echo, tcplistener), unixserver(echo, unixlistener);
+	tcp::client tcpc;
+	tcpc.open("127.0.0.1", std::to_string(ntohs(in.sin_port)));
+	unix::client unixc;
+	unixc.open(path);
+
+	std::printf("%-6s %7s %10s %9s %9s %9s\n", "", "bytes", "trips/s", "p50 us", "p99 us", "p999 us");
+	for (size_t size : { 64, 1024, 16*1024, 64*1024 }) {
+		measure("tcp", tcpc, size, count);
+		measure("unix", unixc, size, count);
+	}
+
+	tcpc.close();
+	unixc.close();
+	tcpserver.join();
+	unixserver.join();
+	close(tcplistener);
+	close(unixlistener);
+	return 0;
+}
\ No newline at end of file
@@ -69,12 +69,12 @@ namespace inet
 		unsigned int _maxread;
 
 		bool _inlimit = false;
-		
-	private:
 
 		// Positioning
 
 		virtual int sync() override;
+		
+	private:
 
 		// Get area
 
@@ -293,8 +293,9 @@ namespace inet
 		while (true) {
 			while (_ocur != _obuffer+_osize && i < count)
 				*_ocur++ = s[i++];
+			// The buffer is full, write it out to make room for the rest
 			if (i != count) {
-				if (overflow() == traits_type::eof())
+				if (sync() == -1)
 					break;
 			}
 			else 
@@ -1,34 +1,185 @@
 #include "client.hpp"
 #include "../tls/tlsclient.hpp"
+#include "../unix/unixclient.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <sys/stat.h>
+
+#if (defined _WIN32 || defined WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 using namespace inet::http;
 
+// Header names are case insensitive, returns nullptr if the header is missing
+static const std::string * findheader(const std::map<std::string, std::string>& header, std::string_view name)
+{
+	for (const auto& pair : header) {
+		if (pair.first.size() == name.size() && std::equal(name.begin(), name.end(), pair.first.begin(),
+			[](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); }))
+			return &pair.second;
+	}
+	return nullptr;
+}
+
+static bool contains(const std::string *value, std::string_view token)
+{
+	if (value == nullptr)
+		return false;
+	std::string lower(*value);
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return lower.find(token) != std::string::npos;
+}
+
+// Only these can safely be sent twice or pipelined
+static bool idempotent(method_e m)
+{
+	return m == method_e::GET || m == method_e::HEAD;
+}
+
+namespace
+{
+// Reads the pieces of a request body from the source on its own thread, one piece ahead of the one being written
+class prefetcher
+{
+public:
+
+    prefetcher(const client::source_t& source, size_t chunk)
+        : _source(source), _chunk(std::max<size_t>(chunk, 1)), _buffers{ std::vector<char>(_chunk), std::vector<char>(_chunk) }
+    {
+        _thread = std::thread([this] { run(); });
+    }
+
+    ~prefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    // Waits for the next piece, which stays valid until the next call. Returns 0 at the end, rethrows what the
+    // source threw.
+    size_t next(const char *& data)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _ready; });
+        if (_error)
+            std::rethrow_exception(_error);
+        _ready = false;
+        data = _buffers[_index].data();
+        auto size = _size;
+        lock.unlock();
+        _cv.notify_all();
+        return size;
+    }
+
+private:
+
+    void run()
+    {
+        for (unsigned int index = 0; ; index ^= 1) {
+            // The buffer is free once the piece after the one that was in it has been taken
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this] { return _stop || !_ready; });
+                if (_stop)
+                    return;
+            }
+            size_t size = 0;
+            std::exception_ptr error;
+            try {
+                size = _source(_buffers[index].data(), _chunk);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _index = index;
+                _size = std::min(size, _chunk);
+                _error = error;
+                _ready = true;
+            }
+            _cv.notify_all();
+            if (size == 0 || error)
+                return;
+        }
+    }
+
+    const client::source_t& _source;
+
+    size_t _chunk;
+
+    std::vector<char> _buffers[2];
+
+    std::mutex _mutex;
+
+    std::condition_variable _cv;
+
+    bool _ready = false;
+
+    bool _stop = false;
+
+    unsigned int _index = 0;
+
+    size_t _size = 0;
+
+    std::exception_ptr _error;
+
+    std::thread _thread;
+};
+}
+
 client::client(bool encryption)
     : _encryption(encryption), _con(nullptr)
 {
-    if (encryption)
-        _con = new tls::client;
-    else
-        _con = new tcp::client;
+    _createcon();
 }
 
 client::client(client&& rhs) noexcept
 {
 	_host = std::move(rhs._host);
+	_unixpath = std::move(rhs._unixpath);
 	_encryption = rhs._encryption;
+	_telemetry = rhs._telemetry;
+	_earlydata = rhs._earlydata;
+	_dns = rhs._dns;
+	_teardown = rhs._teardown;
+	_teardowndeadline = rhs._teardowndeadline;
+	_keepalive = rhs._keepalive;
+	_idle = rhs._idle;
+	_connidle = rhs._connidle;
+	_served = rhs._served;
+	_lastused = rhs._lastused;
+	_tlsctx = std::move(rhs._tlsctx);
 	_con = rhs._con;
-	_rstack = std::move(rhs._rstack);
+	_depth = rhs._depth;
+	_inflight = std::move(rhs._inflight);
+	_queued = std::move(rhs._queued);
+	_bodymode = rhs._bodymode;
+	_bodyleft = rhs._bodyleft;
+	_closeafter = rhs._closeafter;
+	_time = rhs._time;
+	_trailers = std::move(rhs._trailers);
 	rhs._con = nullptr;
 }
 
 client::client(std::string_view host, bool encryption)
     : _host(host), _encryption(encryption), _con(nullptr)
 {
-    if (encryption)
-        _con = new tls::client;
-    else
-        _con = new tcp::client;
+    _createcon();
 }
 
 client::~client()
@@ -44,6 +195,18 @@ bool client::isconnected() const
 	return _con->is_open();
 }
 
+bool client::tcpinfo(tcp::info& i) const
+{
+	auto con = dynamic_cast<const tcp::client*>(_con);
+	return con != nullptr && con->getinfo(i);
+}
+
+client& client::settelemetry(bool telemetry)
+{
+	_telemetry = telemetry;
+	return *this;
+}
+
 client& client::sethost(std::string_view host)
 {
     assert(!_con->is_open());
@@ -56,33 +219,115 @@ client& client::setencryption(bool encryption)
     assert(!_con->is_open() && encryption != _encryption);
     delete _con;
     _encryption = encryption;
-    if (encryption)
-        _con = new tls::client;
+    _createcon();
+    return *this;
+}
+
+client& client::setunixpath(std::string_view path)
+{
+    assert(!_con->is_open());
+    delete _con;
+    _unixpath = path;
+    _createcon();
+    return *this;
+}
+
+void client::_createcon()
+{
+    // TLS is not used over unix sockets, the peer is on the same host
+    tcp::client *con;
+    if (!_unixpath.empty())
+        con = new unix::client;
+    else if (_encryption) {
+        auto tlscon = _tlsctx ? new tls::client(_tlsctx) : new tls::client;
+        tlscon->enable_early_data(_earlydata);
+        con = tlscon;
+    }
     else
-        _con = new tcp::client;
+        con = new tcp::client;
+    con->setdnscache(_dns);
+    con->set_teardown(_teardown, _teardowndeadline);
+    _con = con;
+}
+
+client& client::settlscontext(std::shared_ptr<tls::context> ctx)
+{
+    assert(!_con->is_open());
+    _tlsctx = std::move(ctx);
+    if (_encryption && _unixpath.empty())
+        static_cast<tls::client*>(_con)->setcontext(_tlsctx ? _tlsctx : tls::context::shared());
     return *this;
 }
 
-client& client::connect()
+client& client::setearlydata(bool early)
 {
     assert(!_con->is_open());
-    if (_encryption)
+    _earlydata = early;
+    if (_encryption && _unixpath.empty())
+        static_cast<tls::client*>(_con)->enable_early_data(early);
+    return *this;
+}
+
+client& client::setteardown(tcp::teardown_e policy, unsigned int deadline)
+{
+    _teardown = policy;
+    _teardowndeadline = deadline;
+    static_cast<tcp::client*>(_con)->set_teardown(policy, deadline);
+    return *this;
+}
+
+client& client::setkeepalive(bool keepalive, unsigned int idle)
+{
+    _keepalive = keepalive;
+    _idle = idle;
+    return *this;
+}
+
+client& client::setpipelining(unsigned int depth)
+{
+    _depth = std::max(depth, 1u);
+    return *this;
+}
+
+client& client::setdnscache(tcp::dnscache *cache)
+{
+    _dns = cache;
+    static_cast<tcp::client*>(_con)->setdnscache(cache);
+    return *this;
+}
+
+void client::_opencon()
+{
+    if (!_unixpath.empty())
+        _con->open(_unixpath, "");
+    else if (_encryption)
         _con->open(_host, "https");
     else
         _con->open(_host, "http");
+}
+
+client& client::connect()
+{
+    assert(!_con->is_open());
+    _opencon();
     
     // Verify the connection and enable all exceptions
     if (!_con->is_open())
         throw exception(except_e::OPEN_FAIL);
     _con->exceptions(std::ios_base::eofbit | std::ios_base::failbit | std::ios_base::badbit);
 	_con->enable_timeout(5000);
+    _served = 0;
+    _connidle = _idle;
+    _lastused = std::chrono::steady_clock::now();
     return *this;
 }
 
 client& client::disconnect()
 {
 	if (_con->is_open()) {
-		_rstack.clear();
+		_bodymode = body_e::NONE;
+		_inflight.clear();
+		_queued.clear();
 		_con->close();
 	}
     return *this;
@@ -98,42 +343,303 @@ client& client::send(method_e m, std::string_view r, const char *data, unsigned
 
 client& client::send(const message& m)
 {
-    assert(_con->is_open());
+    _prepare(m.method());
 
-    // Create the intial command line
-    std::string commandline = std::to_string(m.method()) + " " + std::string(m.resource()) + " " + "HTTP/1.1\r\n";
-    (*_con) << commandline;
-
-    // Add the headers
-    for (auto pair : m) {
-        (*_con) << pair.first << ": " << pair.second << "\r\n";
-    }
-    (*_con) << "\r\n";
-
-    // Finally add the data and flush the buffer
+    // Add the data, the request may have to wait for room in the pipeline
+    auto wire = _header(m);
 	unsigned int size = 0;
 	auto data = m.body(size);
     if (size > 0)
-        _con->write(data, size);
-    _con->flush();
+        wire.append(data, size);
+    _queued.push_back({ m.method(), std::chrono::steady_clock::now(), false, std::move(wire) });
+    _flushqueue();
+    return *this;
+}
 
-    // Add the last send command to the stack
-    _rstack.push_back(m.method());
+client& client::send(const message& m, const source_t& source)
+{
+    // The body isn't kept, so it can't be written between other requests or sent again with them
+    if (!_inflight.empty() || !_queued.empty())
+        throw exception(except_e::PENDING_RSP);
+    _prepare(m.method());
+    auto header = _header(m, "Transfer-Encoding: chunked\r\n");
+    _con->write(header.data(), header.size());
+
+    // Every piece becomes a chunk, the last (empty) one ends the body. The timeout only counts while the server
+    // makes no progress, and a body that broke off leaves the connection unusable.
+    try {
+        prefetcher reader(source, 64*1024);
+        char size[24];
+        const char *data;
+        while (auto n = reader.next(data)) {
+            auto len = std::snprintf(size, sizeof(size), "%zx\r\n", n);
+            _con->write(size, len);
+            _con->write(data, n);
+            _con->write("\r\n", 2);
+            _con->reset_timeout();
+        }
+        _con->write("0\r\n\r\n", 5);
+        _con->flush();
+    }
+    catch (...) {
+        _drop();
+        throw;
+    }
+    _inflight.push_back({ m.method(), std::chrono::steady_clock::now(), _served > 0, std::string() });
+    return *this;
+}
+
+client& client::send(const message& m, const source_t& source, uint64_t length)
+{
+    if (!_inflight.empty() || !_queued.empty())
+        throw exception(except_e::PENDING_RSP);
+    _prepare(m.method());
+    auto header = _header(m, "Content-Length: " + std::to_string(length) + "\r\n");
+    _con->write(header.data(), header.size());
+
+    // The server can't tell where a body that is cut short ends, so the connection is given up
+    uint64_t sent = 0;
+    bool overrun = false;
+    try {
+        prefetcher reader(source, static_cast<size_t>(std::min<uint64_t>(length, 64*1024)));
+        const char *data;
+        while (auto n = reader.next(data)) {
+            if ((overrun = n > length-sent))
+                break;
+            _con->write(data, n);
+            _con->reset_timeout();
+            sent += n;
+        }
+        if (sent == length && !overrun)
+            _con->flush();
+    }
+    catch (...) {
+        _drop();
+        throw;
+    }
+    if (sent != length || overrun) {
+        _drop();
+        throw exception(except_e::BODY_LENGTH);
+    }
+    _inflight.push_back({ m.method(), std::chrono::steady_clock::now(), _served > 0, std::string() });
     return *this;
 }
 
+client& client::send(const message& m, std::istream& in)
+{
+    return send(m, [&in](char *data, size_t size) {
+        in.read(data, static_cast<std::streamsize>(size));
+        if (in.bad())
+            throw std::ios_base::failure("Failed to read the request body");
+        return static_cast<size_t>(in.gcount());
+    });
+}
+
+client& client::send(const message& m, int fd)
+{
+    auto source = [fd](char *data, size_t size) {
+#ifndef WINDOWS
+        ssize_t n;
+        while ((n = ::read(fd, data, size)) < 0) {
+#else
+        int n;
+        while ((n = _read(fd, data, static_cast<unsigned int>(std::min<size_t>(size, INT32_MAX)))) < 0) {
+#endif
+            if (errno != EINTR)
+                throw std::system_error(errno, std::system_category(), "Failed to read the request body");
+        }
+        return static_cast<size_t>(n);
+    };
+
+    // The size of a regular file is known up front, what's left of it from the current offset is sent
+#ifndef WINDOWS
+    struct stat st;
+    off_t offset;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (offset = ::lseek(fd, 0, SEEK_CUR)) >= 0 && offset <= st.st_size)
+#else
+    struct _stat64 st;
+    int64_t offset;
+    if (_fstat64(fd, &st) == 0 && (st.st_mode & _S_IFMT) == _S_IFREG && (offset = _lseeki64(fd, 0, SEEK_CUR)) >= 0 &&
+        offset <= st.st_size)
+#endif
+        return send(m, source, static_cast<uint64_t>(st.st_size-offset));
+    return send(m, source);
+}
+
+void client::_prepare(method_e m)
+{
+    // Only reuse an idle connection that is still good, the server may have closed it in the meantime
+    if (_con->is_open() && _inflight.empty() && _served > 0) {
+        auto idle = std::chrono::steady_clock::now()-_lastused;
+        if (!_keepalive || idle > std::chrono::milliseconds(_connidle) || static_cast<tcp::client*>(_con)->is_stale())
+            _drop();
+    }
+    if (!_con->is_open())
+        connect();
+
+    // Only requests that are safe to replay may go out as early data
+    if (_earlydata && _encryption && _unixpath.empty() && !idempotent(m))
+        static_cast<tls::client*>(_con)->handshake();
+}
+
+std::string client::_header(const message& m, std::string_view framing) const
+{
+    // Create the intial command line and add the headers
+    std::string wire = std::to_string(m.method()) + " " + std::string(m.resource()) + " " + "HTTP/1.1\r\n";
+    for (auto pair : m) {
+        if (!framing.empty() && pair.first == "Content-Length")
+            continue;
+        wire.append(pair.first).append(": ").append(pair.second).append("\r\n");
+    }
+    wire.append(framing);
+    if (!_keepalive && findheader(m, "Connection") == nullptr)
+        wire.append("Connection: close\r\n");
+    wire.append("\r\n");
+    return wire;
+}
+
+bool client::_writable(const request& req) const
+{
+    if (_inflight.empty())
+        return true;
+
+    // A non-idempotent request in flight is always alone, so only the last one has to be checked
+    return _inflight.size() < _depth && idempotent(req.method) && idempotent(_inflight.back().method);
+}
+
+void client::_flushqueue()
+{
+    // Write the requests back to back and flush once, so a batch leaves in as few segments as possible
+    bool written = false;
+    while (!_queued.empty() && _writable(_queued.front())) {
+        auto req = std::move(_queued.front());
+        _queued.pop_front();
+        _con->write(req.wire.data(), req.wire.size());
+        req.sent = std::chrono::steady_clock::now();
+        req.reused = _served > 0 || !_inflight.empty();
+        if (!idempotent(req.method))
+            req.wire.clear();
+        _inflight.push_back(std::move(req));
+        written = true;
+    }
+    if (written)
+        _con->flush();
+}
+
+bool client::_resend(bool reusedonly)
+{
+    // A fresh connection that fails the first request is not retried
+    if (reusedonly && (_inflight.empty() || !_inflight.front().reused))
+        return false;
+    for (const auto& req : _inflight) {
+        if (req.wire.empty())
+            return false;
+    }
+
+    // Put the unanswered requests back in front of the queue and start over on a new connection
+    std::deque<request> pending = std::move(_inflight);
+    pending.insert(pending.end(), std::make_move_iterator(_queued.begin()), std::make_move_iterator(_queued.end()));
+    _drop();
+    connect();
+    _queued = std::move(pending);
+    _flushqueue();
+    return true;
+}
+
+void client::_drop()
+{
+    auto con = static_cast<tcp::client*>(_con);
+    con->set_teardown(tcp::teardown_e::ABORTIVE);
+    disconnect();
+    con->set_teardown(_teardown, _teardowndeadline);
+}
+
 client& client::retrieve(response& r)
 {
-    // Retrieve the corresponding request method
-    assert(_rstack.size() > 0);
-    auto m = _rstack.back();
+    retrieveheader(r);
+    if (r.status == status_e::CONTINUE) {
+        return *this;
+    }
+
+    // Set a 50MB body soft limit, larger bodies should be streamed
+    constexpr unsigned int limit = 50*1024*1024;
+    _con->enable_read_limit(limit);
+    if (_bodymode == body_e::LENGTH && _bodyleft <= limit) {
+        // The data is send in one piece
+        r.body.resize(static_cast<size_t>(_bodyleft));
+        size_t offset = 0;
+        while (offset < r.body.size())
+            offset += readbody(r.body.data()+offset, r.body.size()-offset);
+    }
+    else {
+        while (_bodymode != body_e::NONE) {
+            auto oldsize = r.body.size();
+            r.body.resize(oldsize+16*1024);
+            r.body.resize(oldsize+readbody(r.body.data()+oldsize, 16*1024));
+        }
+    }
+    r.time = _time;
+    for (const auto& pair : _trailers)
+        r.header[pair.first] = pair.second;
+    return *this;
+}
+
+client& client::retrieve(response& r, const sink_t& sink, size_t chunk)
+{
+    // Empty pieces would never get through the body
+    if (chunk == 0)
+        throw exception(except_e::INVALID_ARG);
+
+    retrieveheader(r);
+    if (r.status == status_e::CONTINUE) {
+        return *this;
+    }
+
+    // The body goes straight to the sink, so its size isn't limited
+    std::vector<char> buffer(chunk);
+    while (_bodymode != body_e::NONE) {
+        auto n = readbody(buffer.data(), buffer.size());
+        if (n > 0 && !sink(buffer.data(), n)) {
+            skipbody();
+            break;
+        }
+    }
+    r.time = _time;
+    for (const auto& pair : _trailers)
+        r.header[pair.first] = pair.second;
+    return *this;
+}
+
+client& client::retrieveheader(response& r)
+{
+    // Retrieve the corresponding request method, responses arrive in the order the requests were written
+    assert(_inflight.size() > 0);
+    assert(_bodymode == body_e::NONE);
+    auto m = _inflight.front().method;
+    r.time = timing();
+    r.time.sent = _inflight.front().sent;
+    r.header.clear();
+    r.body.clear();
+    _trailers.clear();
 
 	// Set an 8KB header soft limit
 	_con->enable_read_limit(8*1024);
 
-    // Grab and decode the status line (e.g. HTTP/1.1 200 OK)
+    // Grab and decode the status line (e.g. HTTP/1.1 200 OK), a reused connection may have been closed by the server
     std::string str;
-    _con->getCRLF(str);
+    try {
+        _con->getCRLF(str);
+    }
+    catch (...) {
+        if (!_resend())
+            throw;
+        m = _inflight.front().method;
+        r.time.sent = _inflight.front().sent;
+        _con->enable_read_limit(8*1024);
+        str.clear();
+        _con->getCRLF(str);
+    }
+    r.time.firstbyte = std::chrono::steady_clock::now();
     if (str[5] == '0' && str[7] == '9')
         r.version = version_e::HTTP09;
     else if (str[5] == '1' && str[7] == '0')
@@ -159,74 +665,161 @@ client& client::retrieve(response& r)
         // Store the header line (eg. "Connection: closed")
         r.header[str.substr(0, str.find(':'))] = str.substr(str.find(':')+2);
     }
+    if (_encryption && _unixpath.empty())
+        r.time.handshake = static_cast<tls::client*>(_con)->handshake_time();
 
-	// Set a 50MB body soft limit (this client is not designed for large file transfer)
-	_con->enable_read_limit(50*1024*1024);
-
-    // Not an actual response to a request, so no body and the stack remains the same, also connection is guaranteed to remain open
+    // Not an actual response to a request, so no body and the queue remains the same, also connection is guaranteed to remain open
 	if (r.status == status_e::CONTINUE) {
-		r.body.clear();
+		r.time.complete = std::chrono::steady_clock::now();
 		return *this;
 	}
 
-    // HEAD's reply does not contain a body
-    if (m != method_e::HEAD) {
-		// The data is send in one piece
-		if (r.header.count("Content-Length") == 1) {
-			auto size = std::stoi(r.header["Content-Length"]);
-			if (size > 0) {
-				r.body.resize(size);
-				_con->read(r.body.data(), size);
-			}
-			else {
-				r.body.clear();
-			}
-		}
-        // Chunked encoding is used
-        else if (r.version == version_e::HTTP11 && r.header.count("Transfer-Encoding") == 1 && 
-            r.header["Transfer-Encoding"].find("chunked") != std::string::npos) 
-        {
-            bool footer = false;
-            while (true) {
-                // Grab a line, if we are reading footers and the line is empty, the transmission is over
-                str.clear();
-                _con->getCRLF(str);
-                if (footer && str.size() == 0)
-                    break;
-
-                // We are reading a single chunk (a chunk with length 0 indicates the beginning of the footers)
-                if (!footer) {
-                    auto chunksize = std::stoi(str, nullptr, 16);
-                    if (chunksize == 0)
-                        footer = true;
-                    else {
-                        auto oldsize = r.body.size();
-                        r.body.resize(oldsize+chunksize);
-                        _con->read(r.body.data()+oldsize, chunksize);
-                        _con->ignore(2); // CRLF after the data
-                    }
-                }
-                // We are reading a single footer
-                else {
-                    r.header[str.substr(0, str.find(':'))] = str.substr(str.find(':')+2);
+    // Work out how the body is framed (RFC 7230 3.3.3), replies to HEAD and 1xx, 204 and 304 responses never carry one
+    // whatever their headers say, chunked coding wins over a length
+    auto length = findheader(r.header, "Content-Length");
+    auto encoding = findheader(r.header, "Transfer-Encoding");
+    auto connection = findheader(r.header, "Connection");
+    auto status = static_cast<int>(r.status);
+    _bodymode = body_e::NONE;
+    _bodyleft = 0;
+    if (m == method_e::HEAD || status < 200 || r.status == status_e::NO_CONTENT || r.status == status_e::NOT_MODIFIED)
+        _bodymode = body_e::NONE;
+    else if (r.version == version_e::HTTP11 && contains(encoding, "chunked"))
+        _bodymode = body_e::CHUNKED;
+    else if (length) {
+        _bodyleft = std::stoull(*length);
+        _bodymode = _bodyleft > 0 ? body_e::LENGTH : body_e::NONE;
+    }
+    // Without a length the body lasts until the server closes the connection
+    else
+        _bodymode = body_e::CLOSE;
+
+    // The connection is closed after the body if the server closes it, HTTP/1.0 servers close unless they explicitly
+    // keep the connection alive, and a body delimited by the close leaves nothing to reuse
+    _closeafter = !_keepalive || contains(connection, "close") || (r.version == version_e::HTTP10 && !contains(connection, "keep-alive")) ||
+        _bodymode == body_e::CLOSE;
+
+    // The server tells how long it keeps idle connections around (e.g. "Keep-Alive: timeout=5, max=100")
+    auto keepalive = findheader(r.header, "Keep-Alive");
+    if (keepalive) {
+        auto pos = keepalive->find("timeout=");
+        if (pos != std::string::npos) {
+            auto timeout = std::strtoul(keepalive->c_str()+pos+8, nullptr, 10);
+            if (timeout > 0)
+                _connidle = std::min<unsigned int>(_connidle, static_cast<unsigned int>(timeout*1000));
+        }
+    }
+
+    // The caller decides how much body it takes
+    _con->disable_read_limit();
+    _time = r.time;
+    if (_bodymode == body_e::NONE) {
+        _endbody();
+        r.time = _time;
+    }
+    return *this;
+}
+
+size_t client::readbody(char *data, size_t size)
+{
+    if (_bodymode == body_e::NONE || size == 0)
+        return 0;
+
+    size_t n = 0;
+    switch (_bodymode) {
+    case body_e::LENGTH:
+        n = static_cast<size_t>(std::min<uint64_t>(size, _bodyleft));
+        _con->read(data, n);
+        _bodyleft -= n;
+        if (_bodyleft == 0)
+            _endbody();
+        break;
+    case body_e::CHUNKED:
+        // At the start of a chunk read its size, a chunk with length 0 indicates the beginning of the footers
+        if (_bodyleft == 0) {
+            std::string str;
+            _con->getCRLF(str);
+            _bodyleft = std::stoull(str, nullptr, 16);
+            if (_bodyleft == 0) {
+                while (true) {
+                    str.clear();
+                    _con->getCRLF(str);
+                    if (str.size() == 0)
+                        break;
+                    _trailers[str.substr(0, str.find(':'))] = str.substr(str.find(':')+2);
                 }
+                _endbody();
+                return 0;
             }
         }
-		else {	
-			r.body.clear();
-		}
+        n = static_cast<size_t>(std::min<uint64_t>(size, _bodyleft));
+        _con->read(data, n);
+        _bodyleft -= n;
+        if (_bodyleft == 0)
+            _con->ignore(2); // CRLF after the data
+        break;
+    case body_e::CLOSE:
+        _con->exceptions(std::ios_base::badbit);
+        _con->read(data, size);
+        n = static_cast<size_t>(_con->gcount());
+        if (_con->eof()) {
+            _con->clear();
+            _endbody();
+        }
+        if (_con->is_open())
+            _con->exceptions(std::ios_base::eofbit | std::ios_base::failbit | std::ios_base::badbit);
+        break;
+    default:
+        break;
     }
-	else {
-		r.body.clear();
-	}
+    return n;
+}
 
-    // Pop the message stack and close the client->server connection if the server->client connection closes
-    _rstack.pop_back();
-    if (r.header.count("Connection") && r.header["Connection"].find("close") != std::string::npos)
-        disconnect();
+client& client::skipbody()
+{
+    if (_bodymode == body_e::NONE)
+        return *this;
+
+    // The rest of the body is still on the connection, so it can't be used for anything else
+    _bodymode = body_e::NONE;
+    _time.complete = std::chrono::steady_clock::now();
+    _inflight.pop_front();
+    if (_inflight.empty() && _queued.empty())
+        _drop();
+    else if (!_resend(false)) {
+        // The requests behind this one are gone with the connection, their responses would never arrive
+        _drop();
+        throw exception(except_e::REQUESTS_LOST);
+    }
     return *this;
 }
 
+void client::_endbody()
+{
+    // Record the timing before a possible disconnect
+    _bodymode = body_e::NONE;
+    _time.complete = std::chrono::steady_clock::now();
+    if (_telemetry)
+        _time.hasinfo = tcpinfo(_time.info);
+
+    // Pop the request and close the client->server connection if the server->client connection closes
+    _inflight.pop_front();
+    ++_served;
+    _lastused = std::chrono::steady_clock::now();
+    if (_closeafter) {
+        // The server won't answer the rest of the pipeline, send it again over a new connection (only GET and HEAD
+        // are ever behind another request, so all of it can be replayed)
+        if (_inflight.empty() && _queued.empty())
+            disconnect();
+        else
+            _resend(false);
+        return;
+    }
+
+    // A slot in the pipeline opened up
+    _flushqueue();
+}
+
 std::map<std::string, std::string> inet::http::cookieParser(std::string_view str)
 {
 	std::map<std::string, std::string> cookies;
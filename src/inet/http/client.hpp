@@ -2,12 +2,21 @@
 
 #include "../gconnection.hpp"
 #include "types.hpp"
+#include <memory>
+#include <deque>
+#include <functional>
+#include <istream>
 
 namespace inet::http2
 {
     class client;
 }
 
+namespace inet::tls
+{
+    class context;
+}
+
 namespace inet::http
 {
     class client
@@ -16,6 +25,12 @@ namespace inet::http
 
     public:
 
+        // Receives the body piece by piece, returning false stops the transfer (the connection is replaced)
+        typedef std::function<bool(const char *data, size_t size)> sink_t;
+
+        // Produces the request body piece by piece, fills up to size bytes and returns how many, 0 ends the body
+        typedef std::function<size_t(char *data, size_t size)> source_t;
+
         client() = delete;
 
         client(bool encryption = true);
@@ -30,12 +45,43 @@ namespace inet::http
 
 		bool isconnected() const;
 
+        // Takes a TCP_INFO snapshot of the underlying connection, returns false if that's not possible
+        bool tcpinfo(tcp::info& i) const;
+
+        // Attaches a TCP_INFO snapshot to every retrieved response (costs a syscall per response)
+        client& settelemetry(bool telemetry);
+
         // Changes the host.
         client& sethost(std::string_view host);
 
         // Enables/disables TLS, CHANGING THIS VALUE IS EXPENSIVE!
         client& setencryption(bool encryption);
 
+        // Uses this TLS context instead of the process wide default, nullptr goes back to the default
+        client& settlscontext(std::shared_ptr<tls::context> ctx);
+
+        // Sends GET and HEAD requests as TLS 1.3 early data on resumed connections, other methods wait for the handshake
+        client& setearlydata(bool early);
+
+        // Resolves the host through the cache (owned by the caller), nullptr disables it
+        client& setdnscache(tcp::dnscache *cache);
+
+        // Keeps the connection open between requests (HTTP/1.1 persistent connections). A connection that has been
+        // idle for longer than idle ms, or longer than the server announced, is replaced before it's used again.
+        client& setkeepalive(bool keepalive, unsigned int idle = 30000);
+
+        // Allows up to depth requests on the connection before the first response arrives (1 disables pipelining).
+        // Requests beyond the depth are queued and written as responses come in. Methods other than GET and HEAD
+        // are never pipelined, they wait for the requests before them and hold back the ones after them.
+        client& setpipelining(unsigned int depth);
+
+        // Changes how the connection is torn down, the whole response has been read by then so the default doesn't
+        // wait for the server's close_notify
+        client& setteardown(tcp::teardown_e policy, unsigned int deadline = 1000);
+
+        // Connects through a unix domain socket instead of TCP (the host is still sent), an empty path goes back to TCP
+        client& setunixpath(std::string_view path);
+
         // Connects to the server.
         client& connect();
 
@@ -45,22 +91,135 @@ namespace inet::http
         // Sends a HTTP command to the server, creates a suitable message in place, includes an optional body.
         client& send(method_e m, std::string_view r, const char *data = nullptr, unsigned int size = 0);
 
-        // Sends a HTTP command to the server
+        // Sends a HTTP command to the server, (re)connects if needed. An idle connection that went stale is replaced first.
         client& send(const message& m);
 
-        // Retrieves the response from the HTTP server to the last message, will automatically close the connection
-        // if the server sends "Connection: close".
+        // Sends the request with the body coming from the source, with chunked encoding as the size isn't known. The
+        // next piece is read on another thread while the previous one is written, so only two pieces are held at a
+        // time. The body isn't kept, so the request is neither queued nor sent again: the responses to the earlier
+        // requests have to be retrieved first, or it throws.
+        client& send(const message& m, const source_t& source);
+
+        // Same as above with a Content-Length instead, throws if the source produces more or less than length bytes
+        client& send(const message& m, const source_t& source, uint64_t length);
+
+        // Streams the body from the stream until it runs out
+        client& send(const message& m, std::istream& in);
+
+        // Streams the body from the file descriptor until it runs out, a regular file is sent with its size
+        client& send(const message& m, int fd);
+
+        // Retrieves the response to the oldest outstanding request, will automatically close the connection if the
+        // server sends "Connection: close". GET and HEAD requests the old connection didn't answer (because the server
+        // closed a reused connection or stopped in the middle of a pipeline) are sent again over a new connection.
         client& retrieve(response& r);
 
+        // Retrieves the response like above, but hands the body to the sink in pieces of at most chunk bytes instead
+        // of storing it, there's no limit on the size. Trailers end up in the header. Throws if chunk is 0.
+        client& retrieve(response& r, const sink_t& sink, size_t chunk = 64*1024);
+
+        // Retrieves the status line and the headers only, the body has to be read with readbody (or skipped) before
+        // the next response can be retrieved
+        client& retrieveheader(response& r);
+
+        // Reads up to size bytes of the body, chunked encoding is decoded on the way. Returns 0 once the body is over.
+        size_t readbody(char *data, size_t size);
+
+        // Gives up on the rest of the body, the connection is replaced and the outstanding requests are sent again.
+        // Throws if one of them can't be sent again, none of them will get a response then.
+        client& skipbody();
+
     private:
 
+        struct request
+        {
+            method_e method;
+
+            std::chrono::steady_clock::time_point sent;
+
+            // Whether the connection already served or was sent something when this request went out
+            bool reused;
+
+            // The serialized request, only kept after it's written if it can be sent again
+            std::string wire;
+        };
+
+        // Whether the request may be written now, given what's in flight
+        bool _writable(const request& req) const;
+
+        // Writes as many queued requests as the pipeline allows in a single flush
+        void _flushqueue();
+
+        // Makes sure there's a usable connection for the request
+        void _prepare(method_e m);
+
+        // The request line and the headers, framing replaces the message's own Content-Length if it's given
+        std::string _header(const message& m, std::string_view framing = {}) const;
+
+        void _createcon();
+
+        void _opencon();
+
+        // Sends the requests that are still waiting for a response again over a new connection
+        bool _resend(bool reusedonly = true);
+
+        // Closes a connection the server already gave up on, without writing to it
+        void _drop();
+
+        // The body has been read, moves on to the next response
+        void _endbody();
+
+        // How the body of the current response ends
+        enum class body_e { NONE, LENGTH, CHUNKED, CLOSE };
+
         std::string _host;
 
+        std::string _unixpath;
+
         bool _encryption;
 
+        bool _telemetry = false;
+
+        bool _earlydata = false;
+
+        tcp::dnscache *_dns = nullptr;
+
+        tcp::teardown_e _teardown = tcp::teardown_e::UNIDIRECTIONAL;
+
+        unsigned int _teardowndeadline = 1000;
+
+        bool _keepalive = true;
+
+        unsigned int _idle = 30000;
+
+        // Per connection state, the idle limit can be lowered by the server's Keep-Alive header
+        unsigned int _connidle = 30000;
+
+        unsigned int _served = 0;
+
+        std::chrono::steady_clock::time_point _lastused;
+
+        unsigned int _depth = 1;
+
+        std::shared_ptr<tls::context> _tlsctx;
+
         gconnection<char> *_con;
 
-        std::vector<method_e> _rstack;
+        // Requests written to the connection in order, and the ones waiting for room in the pipeline
+        std::deque<request> _inflight;
+
+        std::deque<request> _queued;
+
+        // State of the response whose body is being read, bodyleft is what's left of the body or the current chunk
+        body_e _bodymode = body_e::NONE;
+
+        uint64_t _bodyleft = 0;
+
+        bool _closeafter = false;
+
+        timing _time;
+
+        std::map<std::string, std::string> _trailers;
     };
 
 	std::map<std::string, std::string> cookieParser(std::string_view str);
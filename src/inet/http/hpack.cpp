@@ -0,0 +1,658 @@
+#include "hpack.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <unordered_map>
+
+using namespace inet::http;
+using namespace inet::http::hpack;
+
+// RFC 7541 appendix A
+static const std::pair<const char*, const char*> statictable[table::statics] = {
+    { ":authority", "" }, { ":method", "GET" }, { ":method", "POST" }, { ":path", "/" }, { ":path", "/index.html" },
+    { ":scheme", "http" }, { ":scheme", "https" }, { ":status", "200" }, { ":status", "204" }, { ":status", "206" },
+    { ":status", "304" }, { ":status", "400" }, { ":status", "404" }, { ":status", "500" }, { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" }, { "accept-language", "" }, { "accept-ranges", "" }, { "accept", "" },
+    { "access-control-allow-origin", "" }, { "age", "" }, { "allow", "" }, { "authorization", "" },
+    { "cache-control", "" }, { "content-disposition", "" }, { "content-encoding", "" }, { "content-language", "" },
+    { "content-length", "" }, { "content-location", "" }, { "content-range", "" }, { "content-type", "" },
+    { "cookie", "" }, { "date", "" }, { "etag", "" }, { "expect", "" }, { "expires", "" }, { "from", "" }, { "host", "" },
+    { "if-match", "" }, { "if-modified-since", "" }, { "if-none-match", "" }, { "if-range", "" },
+    { "if-unmodified-since", "" }, { "last-modified", "" }, { "link", "" }, { "location", "" }, { "max-forwards", "" },
+    { "proxy-authenticate", "" }, { "proxy-authorization", "" }, { "range", "" }, { "referer", "" }, { "refresh", "" },
+    { "retry-after", "" }, { "server", "" }, { "set-cookie", "" }, { "strict-transport-security", "" },
+    { "transfer-encoding", "" }, { "user-agent", "" }, { "vary", "" }, { "via", "" }, { "www-authenticate", "" }
+};
+
+// RFC 7541 appendix B, the last entry is EOS
+static const struct { uint32_t code; uint8_t bits; } huffmantable[257] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 }, { 0xfffffe4, 28 }, { 0xfffffe5, 28 },
+    { 0xfffffe6, 28 }, { 0xfffffe7, 28 }, { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+    { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 }, { 0xfffffed, 28 }, { 0xfffffee, 28 },
+    { 0xfffffef, 28 }, { 0xffffff0, 28 }, { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+    { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 }, { 0xffffff8, 28 }, { 0xffffff9, 28 },
+    { 0xffffffa, 28 }, { 0xffffffb, 28 }, { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 }, { 0x1ff9, 13 },
+    { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 }, { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 }, { 0xfa, 8 },
+    { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 }, { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 }, { 0x1a, 6 }, { 0x1b, 6 },
+    { 0x1c, 6 }, { 0x1d, 6 }, { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 }, { 0x7ffc, 15 }, { 0x20, 6 },
+    { 0xffb, 12 }, { 0x3fc, 10 }, { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 }, { 0x5f, 7 }, { 0x60, 7 },
+    { 0x61, 7 }, { 0x62, 7 }, { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 }, { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 },
+    { 0x6a, 7 }, { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 }, { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+    { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 }, { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+    { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 }, { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 }, { 0x27, 6 },
+    { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 }, { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 }, { 0x2b, 6 }, { 0x76, 7 },
+    { 0x2c, 6 }, { 0x8, 5 }, { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 }, { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 },
+    { 0x7ffe, 15 }, { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 }, { 0xfffe6, 20 }, { 0x3fffd2, 22 },
+    { 0xfffe7, 20 }, { 0xfffe8, 20 }, { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+    { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 }, { 0x7fffdd, 23 }, { 0x7fffde, 23 },
+    { 0xffffeb, 24 }, { 0x7fffdf, 23 }, { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+    { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 }, { 0x7fffe4, 23 }, { 0x1fffdc, 21 },
+    { 0x3fffd8, 22 }, { 0x7fffe5, 23 }, { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+    { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 }, { 0x3fffdc, 22 }, { 0x7fffe8, 23 },
+    { 0x7fffe9, 23 }, { 0x1fffde, 21 }, { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+    { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 }, { 0x1fffe0, 21 }, { 0x1fffe1, 21 },
+    { 0x3fffe0, 22 }, { 0x1fffe2, 21 }, { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+    { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 }, { 0x7ffff0, 23 }, { 0x3fffe5, 22 },
+    { 0x3fffe6, 22 }, { 0x7ffff1, 23 }, { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+    { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 }, { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 },
+    { 0x3ffffe4, 26 }, { 0x7ffffde, 27 }, { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+    { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 }, { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 },
+    { 0x7ffffe2, 27 }, { 0xfffff2, 24 }, { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+    { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 }, { 0xfffec, 20 }, { 0xfffff3, 24 },
+    { 0xfffed, 20 }, { 0x1fffe6, 21 }, { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+    { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 }, { 0xfffff4, 24 }, { 0xfffff5, 24 },
+    { 0x3ffffea, 26 }, { 0x7ffff4, 23 }, { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+    { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 }, { 0x7ffffeb, 27 }, { 0xffffffe, 28 },
+    { 0x7ffffec, 27 }, { 0x7ffffed, 27 }, { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+    { 0x3fffffff, 30 }
+};
+
+namespace
+{
+    // One step of the decoder: the state after a nibble and the symbol that was completed on the way (codes are at
+    // least 5 bits long, so there's never more than one)
+    struct transition
+    {
+        uint16_t next;
+
+        uint8_t flags;
+
+        uint8_t symbol;
+    };
+
+    constexpr uint8_t EMIT = 0x1;
+    constexpr uint8_t FAIL = 0x2;
+    // The state may end the string, it's reached by at most 7 bits of EOS
+    constexpr uint8_t ACCEPT = 0x4;
+
+    // States are the inner nodes of the code tree, built once from the code table
+    struct huffmanstates
+    {
+        huffmanstates()
+        {
+            // Leaves are stored as -1-symbol
+            std::vector<std::array<int, 2>> tree(1, { 0, 0 });
+            for (int sym = 0; sym < 257; sym++) {
+                int node = 0;
+                for (int bit = huffmantable[sym].bits-1; bit >= 0; bit--) {
+                    auto b = (huffmantable[sym].code >> bit) & 1;
+                    if (bit == 0) {
+                        tree[node][b] = -1-sym;
+                    }
+                    else {
+                        if (tree[node][b] == 0) {
+                            tree[node][b] = static_cast<int>(tree.size());
+                            tree.push_back({ 0, 0 });
+                        }
+                        node = tree[node][b];
+                    }
+                }
+            }
+
+            // Inner nodes that are a short all ones path from the root
+            std::vector<bool> accept(tree.size(), false);
+            for (int node = 0, depth = 0; node > 0 || depth == 0; node = tree[node][1], depth++) {
+                if (depth > 7)
+                    break;
+                accept[node] = true;
+            }
+
+            states.resize(tree.size());
+            for (size_t state = 0; state < tree.size(); state++) {
+                for (int nibble = 0; nibble < 16; nibble++) {
+                    auto& t = states[state][nibble];
+                    t = { 0, 0, 0 };
+                    int node = static_cast<int>(state);
+                    for (int bit = 3; bit >= 0; bit--) {
+                        node = tree[node][(nibble >> bit) & 1];
+                        if (node < 0) {
+                            if (node == -1-256) {
+                                t.flags = FAIL;
+                                break;
+                            }
+                            t.flags |= EMIT;
+                            t.symbol = static_cast<uint8_t>(-1-node);
+                            node = 0;
+                        }
+                    }
+                    if (t.flags & FAIL)
+                        continue;
+                    t.next = static_cast<uint16_t>(node);
+                    if (accept[node])
+                        t.flags |= ACCEPT;
+                }
+            }
+        }
+
+        std::vector<std::array<transition, 16>> states;
+    };
+
+    // Static entries by name, the first index of each name (entries with the same name are next to each other)
+    struct staticindex
+    {
+        staticindex()
+        {
+            for (uint32_t i = table::statics; i > 0; i--)
+                names[statictable[i-1].first] = i;
+        }
+
+        std::unordered_map<std::string_view, uint32_t> names;
+    };
+}
+
+static void putinteger(uint32_t value, uint8_t prefix, uint8_t first, std::string& out)
+{
+    uint32_t mask = (1u << prefix)-1;
+    if (value < mask) {
+        out.push_back(static_cast<char>(first | value));
+        return;
+    }
+    out.push_back(static_cast<char>(first | mask));
+    value -= mask;
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool getinteger(const uint8_t *& data, const uint8_t *end, uint8_t prefix, uint32_t& value)
+{
+    uint8_t mask = static_cast<uint8_t>((1 << prefix)-1);
+    value = *data++ & mask;
+    if (value < mask)
+        return true;
+    for (int shift = 0; shift <= 21; shift += 7) {
+        if (data == end)
+            return false;
+        auto b = *data++;
+        value += static_cast<uint32_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static std::string lowercase(std::string_view str)
+{
+    std::string lower(str);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return lower;
+}
+
+// Connection specific headers are not allowed in HTTP/2, the host moves into :authority
+static bool connectionheader(std::string_view name)
+{
+    static const char *names[] = { "connection", "host", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade" };
+    for (auto n : names) {
+        if (name == n)
+            return true;
+    }
+    return false;
+}
+
+// Joins repeated fields the way HTTP/1.1 would
+static void addheader(std::map<std::string, std::string>& header, const std::string& name, const std::string& value)
+{
+    auto& current = header[name];
+    if (!current.empty())
+        current.append(name == "cookie" ? "; " : ", ");
+    current.append(value);
+}
+
+size_t hpack::huffmanlength(std::string_view str)
+{
+    size_t bits = 0;
+    for (unsigned char c : str)
+        bits += huffmantable[c].bits;
+    return (bits+7)/8;
+}
+
+void hpack::huffmanencode(std::string_view str, std::string& out)
+{
+    // Codes are at most 30 bits, so the accumulator never holds more than 37
+    uint64_t acc = 0;
+    int bits = 0;
+    for (unsigned char c : str) {
+        acc = (acc << huffmantable[c].bits) | huffmantable[c].code;
+        bits += huffmantable[c].bits;
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>(acc >> bits));
+        }
+    }
+
+    // Pad with the most significant bits of EOS
+    if (bits > 0)
+        out.push_back(static_cast<char>((acc << (8-bits)) | (0xff >> bits)));
+}
+
+bool hpack::huffmandecode(const uint8_t *data, size_t len, std::string& out)
+{
+    static const huffmanstates table;
+    uint16_t state = 0;
+    bool accept = true;
+
+    // The shortest code is 5 bits
+    out.reserve(out.size()+len*8/5);
+    for (size_t i = 0; i < len; i++) {
+        for (int shift = 4; shift >= 0; shift -= 4) {
+            const auto& t = table.states[state][(data[i] >> shift) & 0xf];
+            if (t.flags & FAIL)
+                return false;
+            if (t.flags & EMIT)
+                out.push_back(static_cast<char>(t.symbol));
+            state = t.next;
+            accept = t.flags & ACCEPT;
+        }
+    }
+    return accept;
+}
+
+fieldlist hpack::requestfields(const message& m, std::string_view scheme)
+{
+    fieldlist fields;
+    auto host = m.find("Host");
+    auto resource = m.resource();
+    fields.emplace_back(":method", std::to_string(m.method()));
+    fields.emplace_back(":scheme", scheme);
+    if (host != m.end())
+        fields.emplace_back(":authority", host->second);
+    fields.emplace_back(":path", resource.empty() ? "/" : std::string(resource));
+    for (const auto& pair : m) {
+        auto name = lowercase(pair.first);
+        if (!connectionheader(name))
+            fields.emplace_back(std::move(name), pair.second);
+    }
+    return fields;
+}
+
+table::table(uint32_t max)
+    : _max(max)
+{
+}
+
+void table::resize(uint32_t max)
+{
+    _max = max;
+    evict();
+}
+
+void table::insert(std::string_view name, std::string_view value)
+{
+    uint32_t size = static_cast<uint32_t>(name.size()+value.size()+32);
+    if (size > _max) {
+        clear();
+        return;
+    }
+    _entries.emplace_front(name, value);
+    _size += size;
+    evict();
+}
+
+const field * table::get(uint32_t index) const
+{
+    // The static entries are created once, on first use
+    static const std::vector<field> statics(std::begin(statictable), std::end(statictable));
+    if (index == 0)
+        return nullptr;
+    else if (index <= table::statics)
+        return &statics[index-1];
+    else if (index-table::statics-1 < _entries.size())
+        return &_entries[index-table::statics-1];
+    else
+        return nullptr;
+}
+
+uint32_t table::find(std::string_view name, std::string_view value, bool& exact) const
+{
+    static const staticindex index;
+    uint32_t found = 0;
+    exact = false;
+    auto it = index.names.find(name);
+    if (it != index.names.end()) {
+        found = it->second;
+        for (auto i = found; i <= table::statics && name == statictable[i-1].first; i++) {
+            if (value == statictable[i-1].second) {
+                exact = true;
+                return i;
+            }
+        }
+    }
+    for (size_t i = 0; i < _entries.size(); i++) {
+        if (_entries[i].first == name) {
+            if (found == 0)
+                found = static_cast<uint32_t>(table::statics+1+i);
+            if (_entries[i].second == value) {
+                exact = true;
+                return static_cast<uint32_t>(table::statics+1+i);
+            }
+        }
+    }
+    return found;
+}
+
+void table::clear()
+{
+    _entries.clear();
+    _size = 0;
+}
+
+uint32_t table::size() const noexcept
+{
+    return _size;
+}
+
+uint32_t table::max() const noexcept
+{
+    return _max;
+}
+
+size_t table::count() const noexcept
+{
+    return _entries.size();
+}
+
+void table::evict()
+{
+    while (_size > _max) {
+        _size -= static_cast<uint32_t>(_entries.back().first.size()+_entries.back().second.size()+32);
+        _entries.pop_back();
+    }
+}
+
+encoder::encoder(uint32_t tablesize)
+    : _table(tablesize), _minsize(tablesize), _limit(tablesize)
+{
+}
+
+void encoder::settablesize(uint32_t size)
+{
+    _minsize = std::min(_minsize, size);
+    _limit = size;
+    _update = true;
+    _table.resize(size);
+}
+
+void encoder::setpolicy(std::string_view name, index_e policy)
+{
+    for (auto& p : _policies) {
+        if (p.first == name) {
+            p.second = policy;
+            return;
+        }
+    }
+    _policies.emplace_back(name, policy);
+}
+
+void encoder::sethuffman(bool huffman) noexcept
+{
+    _huffman = huffman;
+}
+
+void encoder::encode(const fieldlist& fields, std::string& block)
+{
+    // Size updates go first, a shrink that was undone in the meantime still has to be announced
+    if (_update) {
+        if (_minsize < _limit)
+            putinteger(_minsize, 5, 0x20, block);
+        putinteger(_limit, 5, 0x20, block);
+        _minsize = _limit;
+        _update = false;
+    }
+    for (const auto& f : fields)
+        encodefield(f.first, f.second, block);
+}
+
+void encoder::encode(const std::map<std::string, std::string>& header, std::string& block)
+{
+    fieldlist fields;
+    fields.reserve(header.size());
+    for (const auto& pair : header)
+        fields.emplace_back(lowercase(pair.first), pair.second);
+    encode(fields, block);
+}
+
+void encoder::encode(const message& m, std::string& block, std::string_view scheme)
+{
+    encode(requestfields(m, scheme), block);
+}
+
+void encoder::encode(const response& r, std::string& block)
+{
+    fieldlist fields;
+    fields.reserve(r.header.size()+1);
+    fields.emplace_back(":status", std::to_string(r.status));
+    for (const auto& pair : r.header)
+        fields.emplace_back(lowercase(pair.first), pair.second);
+    encode(fields, block);
+}
+
+void encoder::reset()
+{
+    _table.clear();
+    _table.resize(4096);
+    _minsize = _limit = 4096;
+    _update = false;
+}
+
+const table& encoder::gettable() const noexcept
+{
+    return _table;
+}
+
+index_e encoder::decide(std::string_view name, std::string_view value) const
+{
+    for (const auto& p : _policies) {
+        if (p.first == name)
+            return p.second;
+    }
+
+    // Short cookies are easy to guess through the compressed size (RFC 7541 section 7.1.3)
+    if (name == "authorization" || name == "proxy-authorization" || (name == "cookie" && value.size() < 20))
+        return index_e::NEVER;
+
+    // Entries that would push most of the table out, or that are different in every message
+    static const char *volatiles[] = { "age", "content-length", "content-range", "date", "etag", "expires", "if-modified-since",
+        "if-none-match", "last-modified", "set-cookie" };
+    if (name.size()+value.size()+32 > _table.max()/4*3)
+        return index_e::LITERAL;
+    for (auto v : volatiles) {
+        if (name == v)
+            return index_e::LITERAL;
+    }
+    return index_e::INDEX;
+}
+
+void encoder::encodefield(std::string_view name, std::string_view value, std::string& block)
+{
+    bool exact;
+    auto index = _table.find(name, value, exact);
+    auto policy = decide(name, value);
+    if (exact && policy != index_e::NEVER) {
+        putinteger(index, 7, 0x80, block);
+        return;
+    }
+
+    if (policy == index_e::INDEX)
+        putinteger(index, 6, 0x40, block);
+    else
+        putinteger(index, 4, policy == index_e::NEVER ? 0x10 : 0x00, block);
+    if (index == 0)
+        literal(name, block);
+    literal(value, block);
+    if (policy == index_e::INDEX)
+        _table.insert(name, value);
+}
+
+void encoder::literal(std::string_view str, std::string& out) const
+{
+    // A tie goes to Huffman, as in the examples of RFC 7541
+    auto len = _huffman && !str.empty() ? huffmanlength(str) : str.size()+1;
+    if (len <= str.size()) {
+        putinteger(static_cast<uint32_t>(len), 7, 0x80, out);
+        huffmanencode(str, out);
+    }
+    else {
+        putinteger(static_cast<uint32_t>(str.size()), 7, 0x00, out);
+        out.append(str);
+    }
+}
+
+decoder::decoder(uint32_t tablesize)
+    : _table(tablesize), _max(tablesize)
+{
+}
+
+void decoder::settablesize(uint32_t size)
+{
+    _max = size;
+    if (_table.max() > size)
+        _table.resize(size);
+}
+
+bool decoder::decode(const uint8_t *data, size_t len, fieldlist& fields)
+{
+    auto end = data+len;
+    bool start = true;
+    while (data < end) {
+        uint32_t index;
+
+        // Indexed field
+        if (*data & 0x80) {
+            if (!getinteger(data, end, 7, index))
+                return false;
+            auto f = _table.get(index);
+            if (f == nullptr)
+                return false;
+            fields.push_back(*f);
+            start = false;
+            continue;
+        }
+
+        // Dynamic table size update, only at the start of a block and never above what we announced
+        if ((*data & 0xe0) == 0x20) {
+            if (!start || !getinteger(data, end, 5, index) || index > _max)
+                return false;
+            _table.resize(index);
+            continue;
+        }
+
+        // Literal field with incremental indexing, without indexing or never indexed, the name may be indexed
+        start = false;
+        bool indexing = (*data & 0xc0) == 0x40;
+        if (!getinteger(data, end, indexing ? 6 : 4, index))
+            return false;
+        field f;
+        if (index == 0) {
+            if (!literal(data, end, f.first))
+                return false;
+        }
+        else {
+            auto name = _table.get(index);
+            if (name == nullptr)
+                return false;
+            f.first = name->first;
+        }
+        if (!literal(data, end, f.second))
+            return false;
+        if (indexing)
+            _table.insert(f.first, f.second);
+        fields.push_back(std::move(f));
+    }
+    return true;
+}
+
+bool decoder::decode(const uint8_t *data, size_t len, message& m)
+{
+    fieldlist fields;
+    if (!decode(data, len, fields))
+        return false;
+    for (const auto& f : fields) {
+        if (f.first == ":method") {
+            if (f.second == "GET")
+                m.method(method_e::GET);
+            else if (f.second == "HEAD")
+                m.method(method_e::HEAD);
+            else if (f.second == "POST")
+                m.method(method_e::POST);
+            else
+                return false;
+        }
+        else if (f.first == ":path")
+            m.resource(f.second);
+        else if (f.first == ":authority")
+            m.host(f.second);
+        else if (f.first[0] != ':')
+            addheader(m, f.first, f.second);
+    }
+    return true;
+}
+
+bool decoder::decode(const uint8_t *data, size_t len, response& r)
+{
+    fieldlist fields;
+    if (!decode(data, len, fields))
+        return false;
+    for (const auto& f : fields) {
+        if (f.first == ":status") {
+            if (f.second.size() != 3 || !std::all_of(f.second.begin(), f.second.end(), [](unsigned char c) { return std::isdigit(c); }))
+                return false;
+            r.version = version_e::HTTP20;
+            r.status = static_cast<status_e>(std::stoi(f.second));
+        }
+        else if (f.first[0] != ':')
+            addheader(r.header, f.first, f.second);
+    }
+    return true;
+}
+
+void decoder::reset()
+{
+    _table.clear();
+    _table.resize(_max);
+}
+
+const table& decoder::gettable() const noexcept
+{
+    return _table;
+}
+
+bool decoder::literal(const uint8_t *& data, const uint8_t *end, std::string& str)
+{
+    if (data == end)
+        return false;
+    bool huffman = *data & 0x80;
+    uint32_t len;
+    if (!getinteger(data, end, 7, len) || static_cast<size_t>(end-data) < len)
+        return false;
+    if (huffman) {
+        if (!huffmandecode(data, len, str))
+            return false;
+    }
+    else {
+        str.assign(reinterpret_cast<const char*>(data), len);
+    }
+    data += len;
+    return true;
+}
\ No newline at end of file
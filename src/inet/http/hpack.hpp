@@ -0,0 +1,157 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// HPACK header compression (RFC 7541), usable on its own or by the HTTP/2 client
+namespace inet::http::hpack
+{
+    typedef std::pair<std::string, std::string> field;
+
+    typedef std::vector<field> fieldlist;
+
+    // How a literal field is sent: added to the dynamic table, not added, or not added by any intermediary either
+    enum class index_e { INDEX, LITERAL, NEVER };
+
+    // Length of the Huffman encoding in bytes
+    size_t huffmanlength(std::string_view str);
+
+    void huffmanencode(std::string_view str, std::string& out);
+
+    // Decodes a nibble at a time through a state table, returns false on invalid codes or padding
+    bool huffmandecode(const uint8_t *data, size_t len, std::string& out);
+
+    // The fields of a request: the pseudo headers first (Host becomes :authority), then the other headers in lower
+    // case without the connection specific ones
+    fieldlist requestfields(const message& m, std::string_view scheme = "https");
+
+    // The static table followed by the size bounded dynamic table, indices start at 1
+    class table
+    {
+    public:
+
+        table(uint32_t max = 4096);
+
+        // Changes the limit, evicts entries that don't fit anymore
+        void resize(uint32_t max);
+
+        // Adds an entry at the front, an entry larger than the table empties it
+        void insert(std::string_view name, std::string_view value);
+
+        // Returns nullptr for indices that are out of range
+        const field * get(uint32_t index) const;
+
+        // Index of an entry with the same name and value, or else of one with the same name, 0 if there's neither
+        uint32_t find(std::string_view name, std::string_view value, bool& exact) const;
+
+        void clear();
+
+        uint32_t size() const noexcept;
+
+        uint32_t max() const noexcept;
+
+        size_t count() const noexcept;
+
+        static constexpr uint32_t statics = 61;
+
+    private:
+
+        void evict();
+
+        uint32_t _max;
+
+        uint32_t _size = 0;
+
+        std::deque<field> _entries;
+    };
+
+    class encoder
+    {
+    public:
+
+        encoder(uint32_t tablesize = 4096);
+
+        // Follows the decoder's limit (SETTINGS_HEADER_TABLE_SIZE), the update is announced in the next block
+        void settablesize(uint32_t size);
+
+        // Overrides the decision for a (lower case) header name
+        void setpolicy(std::string_view name, index_e policy);
+
+        // Huffman codes strings unless that makes them longer (default), otherwise they're sent as is
+        void sethuffman(bool huffman) noexcept;
+
+        void encode(const fieldlist& fields, std::string& block);
+
+        // Header names are sent in lower case
+        void encode(const std::map<std::string, std::string>& header, std::string& block);
+
+        // The request with its pseudo headers, Host becomes :authority
+        void encode(const message& m, std::string& block, std::string_view scheme = "https");
+
+        void encode(const response& r, std::string& block);
+
+        // Starts over with an empty table, for a new connection
+        void reset();
+
+        const table& gettable() const noexcept;
+
+    private:
+
+        // Credentials and short cookies are never indexed, values that change with every message are not indexed
+        index_e decide(std::string_view name, std::string_view value) const;
+
+        void encodefield(std::string_view name, std::string_view value, std::string& block);
+
+        void literal(std::string_view str, std::string& out) const;
+
+        table _table;
+
+        // Smallest limit since the last block and the current one, both are announced if they differ
+        uint32_t _minsize;
+
+        uint32_t _limit;
+
+        bool _update = false;
+
+        bool _huffman = true;
+
+        std::vector<std::pair<std::string, index_e>> _policies;
+    };
+
+    class decoder
+    {
+    public:
+
+        decoder(uint32_t tablesize = 4096);
+
+        // The limit we announced, size updates from the encoder can't exceed it
+        void settablesize(uint32_t size);
+
+        // Appends the fields in the block, blocks have to be decoded in the order they were encoded. Returns false if
+        // the block is malformed, the table can't be trusted afterwards.
+        bool decode(const uint8_t *data, size_t len, fieldlist& fields);
+
+        // Fills the method, resource and headers (pseudo headers other than :authority are left out)
+        bool decode(const uint8_t *data, size_t len, message& m);
+
+        bool decode(const uint8_t *data, size_t len, response& r);
+
+        // Starts over with an empty table, for a new connection
+        void reset();
+
+        const table& gettable() const noexcept;
+
+    private:
+
+        bool literal(const uint8_t *& data, const uint8_t *end, std::string& str);
+
+        table _table;
+
+        uint32_t _max;
+    };
+}
\ No newline at end of file
@@ -15,6 +15,14 @@ const char * exception::what() const noexcept
     case except_e::UNKOWN_RSP:
 	case except_e::DECODE_ERR:
         return "Invalid HTTP response";
+    case except_e::BODY_LENGTH:
+        return "The request body doesn't match its Content-Length";
+    case except_e::INVALID_ARG:
+        return "Invalid argument";
+    case except_e::REQUESTS_LOST:
+        return "The connection was closed with requests that can't be sent again still unanswered";
+    case except_e::PENDING_RSP:
+        return "The responses to the earlier requests have to be retrieved first";
     default:
         return "Unkown error occurred";
     }
@@ -40,7 +48,6 @@ message::message(method_e m, std::string_view host)
     _resource = "/";
     (*this)["Host"] = host;
 	(*this)["User-Agent"] = "cppclient/0.10";
-    (*this)["Connection"] = "close";
 }
 
 std::string_view message::host() const
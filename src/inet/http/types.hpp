@@ -4,10 +4,12 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <chrono>
+#include "../tcp/tcpclient.hpp"
 
 namespace inet::http
 {
-    enum class except_e { OPEN_FAIL, UNKOWN_RSP, DECODE_ERR };
+    enum class except_e { OPEN_FAIL, UNKOWN_RSP, DECODE_ERR, BODY_LENGTH, INVALID_ARG, REQUESTS_LOST, PENDING_RSP };
 
     class exception : public std::exception
     {
@@ -71,6 +73,23 @@ namespace inet::http
 		PRECONDITION_REQUIRED = 428, TOO_MANY_REQUESTS = 429, REQUEST_HEADER_FIELDS_TOO_LARGE = 431, UNAVAILABLE_FOR_LEGAL_REASONS = 451 
 	};
 
+    // Per request timing, the TCP snapshot is only taken when telemetry is enabled on the client
+    struct timing
+    {
+        std::chrono::steady_clock::time_point sent;
+
+        std::chrono::steady_clock::time_point firstbyte;
+
+        std::chrono::steady_clock::time_point complete;
+
+        // TLS handshake of the connection the response came in on, 0 without TLS
+        std::chrono::microseconds handshake = std::chrono::microseconds(0);
+
+        bool hasinfo = false;
+
+        tcp::info info;
+    };
+
     struct response
     {
         version_e version;
@@ -82,6 +101,8 @@ namespace inet::http
         std::map<std::string, std::string> header;
 
         std::vector<char> body;
+
+        timing time;
     };
 }
 
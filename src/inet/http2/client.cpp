@@ -0,0 +1,665 @@
+#include "client.hpp"
+#include "../tls/tlsclient.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstring>
+
+using namespace inet::http2;
+
+static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+// Only these can safely be sent twice
+static bool idempotent(inet::http::method_e m)
+{
+    return m == inet::http::method_e::GET || m == inet::http::method_e::HEAD;
+}
+
+client::client(std::string_view host, bool encryption)
+    : _http(host, encryption)
+{
+    _local.push = false;
+    _local.window = 1024*1024;
+}
+
+client::~client()
+{
+}
+
+bool client::isconnected() const
+{
+    return _http.isconnected();
+}
+
+client& client::settlscontext(std::shared_ptr<tls::context> ctx)
+{
+    _http.settlscontext(std::move(ctx));
+    return *this;
+}
+
+client& client::setdnscache(tcp::dnscache *cache)
+{
+    _http.setdnscache(cache);
+    return *this;
+}
+
+client& client::setunixpath(std::string_view path)
+{
+    _http.setunixpath(path);
+    return *this;
+}
+
+client& client::setwindow(uint32_t stream, uint32_t connection)
+{
+    _local.window = std::clamp<uint32_t>(stream, 16384, 0x7fffffff);
+    _connwindow = std::clamp<uint32_t>(connection, 65535, 0x7fffffff);
+    return *this;
+}
+
+client& client::connect()
+{
+    assert(!_con()->is_open());
+    _open();
+    _flushqueue();
+    _con()->flush();
+    return *this;
+}
+
+client& client::disconnect()
+{
+    if (_con()->is_open()) {
+        uint8_t payload[8] = {};
+        try {
+            _writeframe(frame_e::GOAWAY, 0, 0, payload, sizeof(payload));
+            _con()->flush();
+        }
+        catch (...) {
+        }
+        _con()->close();
+    }
+    _active.clear();
+    _queued.clear();
+    _completed.clear();
+    _requests.clear();
+    return *this;
+}
+
+uint32_t client::send(http::method_e m, std::string_view r, const char *data, unsigned int size)
+{
+    http::message msg(m, _http._host);
+    msg.resource(r);
+    msg.body(data, size);
+    return send(msg);
+}
+
+uint32_t client::send(const http::message& m)
+{
+    auto handle = _nextrequest++;
+    auto& s = _requests[handle];
+    s.handle = handle;
+    s.method = m.method();
+
+    // The fields are encoded when the stream opens, blocks have to go out in the order they change the table
+    s.headers = http::hpack::requestfields(m, _http._encryption && _http._unixpath.empty() ? "https" : "http");
+    if (m.count("Host") == 0)
+        s.headers.insert(s.headers.begin()+2, { ":authority", _http._host });
+    unsigned int size = 0;
+    auto data = m.body(size);
+    if (size > 0)
+        s.data.assign(data, size);
+
+    // Requests wait in the queue for a stream, after a GOAWAY until the old connection is done
+    _queued.push_back(&s);
+    try {
+        if (!_con()->is_open())
+            connect();
+        else {
+            _flushqueue();
+            _con()->flush();
+        }
+    }
+    catch (...) {
+        _queued.erase(std::find(_queued.begin(), _queued.end(), &s));
+        _active.erase(s.id);
+        _requests.erase(handle);
+        throw;
+    }
+    return handle;
+}
+
+client& client::retrieve(uint32_t request, http::response& r)
+{
+    auto it = _requests.find(request);
+    assert(it != _requests.end());
+    while (!it->second.done)
+        _step();
+
+    auto s = std::move(it->second);
+    _requests.erase(it);
+    if (s.failed)
+        throw exception(s.failure, s.error);
+    r = std::move(s.response);
+    return *this;
+}
+
+uint32_t client::retrieve(http::response& r)
+{
+    assert(!_requests.empty());
+    while (true) {
+        // Handles that were retrieved by their handle in the meantime are skipped
+        while (!_completed.empty()) {
+            auto handle = _completed.front();
+            _completed.pop_front();
+            if (_requests.count(handle) == 1) {
+                retrieve(handle, r);
+                return handle;
+            }
+        }
+        _step();
+    }
+}
+
+std::chrono::microseconds client::ping()
+{
+    // A connection that is going away is only pinged while it still has streams
+    if (_con()->is_open() && _goaway && _active.empty())
+        _con()->close();
+
+    // The server may have closed a connection we already had (after a GOAWAY, or when it was idle), then the PING
+    // goes out once more over a new one
+    for (bool reused = _con()->is_open(); ; reused = false) {
+        if (!_con()->is_open())
+            connect();
+
+        uint8_t payload[8];
+        ++_pingdata;
+        std::memcpy(payload, &_pingdata, sizeof(payload));
+        _pong = false;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            _writeframe(frame_e::PING, 0, 0, payload, sizeof(payload));
+            _con()->flush();
+            while (!_pong)
+                _readframe();
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-start);
+        }
+        catch (const exception&) {
+            throw;
+        }
+        catch (...) {
+            // Whatever the transport throws (stream failures, tcp or tls errors), the connection is gone
+            _lost();
+            if (!reused)
+                throw exception(except_e::CONNECTION_LOST);
+        }
+    }
+}
+
+size_t client::pending() const noexcept
+{
+    return _requests.size();
+}
+
+uint32_t client::maxstreams() const noexcept
+{
+    return _remote.maxstreams;
+}
+
+inet::tcp::client * client::_con() const
+{
+    return static_cast<tcp::client*>(_http._con);
+}
+
+void client::_open()
+{
+    static const uint8_t alpn[] = { 2, 'h', '2' };
+    bool encrypted = _http._encryption && _http._unixpath.empty();
+    if (!_http._unixpath.empty())
+        _con()->open(_http._unixpath, "");
+    else if (encrypted)
+        static_cast<tls::client*>(_con())->open(_http._host, "https", alpn, sizeof(alpn));
+    else
+        _con()->open(_http._host, "http");
+    if (!_con()->is_open())
+        throw exception(except_e::OPEN_FAIL);
+    if (encrypted && static_cast<tls::client*>(_con())->getalpn() != "h2") {
+        _con()->close();
+        throw exception(except_e::NO_H2);
+    }
+    _con()->exceptions(std::ios_base::eofbit | std::ios_base::failbit | std::ios_base::badbit);
+    _con()->enable_timeout(5000);
+
+    // Until the server's SETTINGS arrive it's assumed to allow the 100 streams RFC 7540 recommends at least
+    _remote = settings();
+    _remote.maxstreams = 100;
+    _sendwindow = 65535;
+    _received = 0;
+    _nextid = 1;
+    _goaway = false;
+    _lastid = 0;
+    _headerstream = 0;
+    _fragment.clear();
+    _decoder.reset();
+    _encoder.reset();
+
+    // The preface, our SETTINGS and the connection window may all go out before the server says anything
+    uint8_t payload[12];
+    payload[0] = 0;
+    payload[1] = static_cast<uint8_t>(setting_e::ENABLE_PUSH);
+    put32(payload+2, 0);
+    payload[6] = 0;
+    payload[7] = static_cast<uint8_t>(setting_e::INITIAL_WINDOW_SIZE);
+    put32(payload+8, _local.window);
+    _con()->write(preface, sizeof(preface)-1);
+    _writeframe(frame_e::SETTINGS, 0, 0, payload, sizeof(payload));
+    if (_connwindow > 65535)
+        _windowupdate(0, _connwindow-65535);
+}
+
+void client::_flushqueue()
+{
+    if (!_con()->is_open() || _goaway)
+        return;
+    while (!_queued.empty() && _active.size() < _remote.maxstreams) {
+        // Stream ids can't be reused, a connection that ran out of them is replaced like after a GOAWAY
+        if (_nextid > 0x7fffffff) {
+            _goaway = true;
+            _lastid = _nextid-2;
+            return;
+        }
+
+        auto s = _queued.front();
+        _queued.pop_front();
+        s->id = _nextid;
+        _nextid += 2;
+        s->window = _remote.window;
+        s->offset = 0;
+        s->attempts++;
+        s->response.time.sent = std::chrono::steady_clock::now();
+        _active[s->id] = s;
+        _writeheaders(*s);
+        _writedata(*s);
+    }
+}
+
+void client::_writeframe(frame_e type, uint8_t flags, uint32_t id, const void *payload, size_t len)
+{
+    uint8_t header[frame::size];
+    frame{ static_cast<uint32_t>(len), type, flags, id }.encode(header);
+    _con()->write(reinterpret_cast<const char*>(header), frame::size);
+    if (len > 0)
+        _con()->write(static_cast<const char*>(payload), len);
+}
+
+void client::_writeheaders(stream& s)
+{
+    std::string block;
+    _encoder.encode(s.headers, block);
+
+    // A block larger than a frame continues in CONTINUATION frames
+    size_t len = std::min<size_t>(block.size(), _remote.framesize);
+    uint8_t flags = (s.data.empty() ? flag::END_STREAM : 0) | (len == block.size() ? flag::END_HEADERS : 0);
+    _writeframe(frame_e::HEADERS, flags, s.id, block.data(), len);
+    for (size_t offset = len; offset < block.size(); offset += len) {
+        len = std::min<size_t>(block.size()-offset, _remote.framesize);
+        _writeframe(frame_e::CONTINUATION, offset+len == block.size() ? flag::END_HEADERS : 0, s.id, block.data()+offset, len);
+    }
+}
+
+void client::_writedata(stream& s)
+{
+    while (s.offset < s.data.size()) {
+        auto len = std::min<int64_t>({ static_cast<int64_t>(s.data.size()-s.offset), _remote.framesize, s.window, _sendwindow });
+        if (len <= 0)
+            return;
+        bool last = s.offset+len == s.data.size();
+        _writeframe(frame_e::DATA, last ? flag::END_STREAM : 0, s.id, s.data.data()+s.offset, static_cast<size_t>(len));
+        s.offset += static_cast<size_t>(len);
+        s.window -= len;
+        _sendwindow -= len;
+    }
+}
+
+void client::_windowupdate(uint32_t id, uint32_t increment)
+{
+    uint8_t payload[4];
+    put32(payload, increment & 0x7fffffff);
+    _writeframe(frame_e::WINDOW_UPDATE, 0, id, payload, sizeof(payload));
+}
+
+void client::_step()
+{
+    // After a GOAWAY the connection is replaced once its last streams are done
+    if (_con()->is_open() && _goaway && _active.empty())
+        _con()->close();
+    if (!_con()->is_open()) {
+        connect();
+        return;
+    }
+
+    // Protocol errors have been dealt with already, anything the transport throws means the connection is gone (the
+    // server may also just close it after a GOAWAY)
+    try {
+        _readframe();
+    }
+    catch (const exception&) {
+        throw;
+    }
+    catch (...) {
+        _lost();
+    }
+}
+
+void client::_readframe()
+{
+    uint8_t header[frame::size];
+    _con()->read(reinterpret_cast<char*>(header), frame::size);
+    frame f;
+    f.decode(header);
+    if (f.length > _local.framesize)
+        _fail(except_e::PROTOCOL_ERR, error_e::FRAME_SIZE);
+    _payload.resize(f.length);
+    if (f.length > 0)
+        _con()->read(_payload.data(), f.length);
+    auto payload = reinterpret_cast<const uint8_t*>(_payload.data());
+
+    // Nothing may come between the frames of a header block
+    if (_headerstream != 0 && (f.type != frame_e::CONTINUATION || f.stream != _headerstream))
+        _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+
+    auto it = _active.find(f.stream);
+    auto s = it != _active.end() ? it->second : nullptr;
+    switch (f.type) {
+    case frame_e::DATA: {
+        size_t offset = 0, len = f.length;
+        if (f.stream == 0)
+            _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+        if (f.flags & flag::PADDED) {
+            if (len == 0 || payload[0] >= len)
+                _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+            offset = 1;
+            len -= 1+payload[0];
+        }
+
+        // Padding counts against the windows as well, data for streams we gave up on only against the connection's
+        _received += f.length;
+        if (s) {
+            auto& body = s->response.body;
+            body.insert(body.end(), _payload.data()+offset, _payload.data()+offset+len);
+            s->received += f.length;
+            if (f.flags & flag::END_STREAM)
+                _complete(*s);
+            else if (s->received >= _local.window/2) {
+                _windowupdate(s->id, s->received);
+                s->received = 0;
+            }
+        }
+        if (_received >= _connwindow/2) {
+            _windowupdate(0, _received);
+            _received = 0;
+        }
+        break;
+    }
+    case frame_e::HEADERS: {
+        size_t offset = 0, len = f.length;
+        if (f.stream == 0)
+            _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+        if (f.flags & flag::PADDED) {
+            if (len == 0 || payload[0] >= len)
+                _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+            offset = 1;
+            len -= 1+payload[0];
+        }
+        if (f.flags & flag::PRIORITY) {
+            if (len < 5)
+                _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+            offset += 5;
+            len -= 5;
+        }
+        _fragment.assign(_payload.data()+offset, len);
+        _headerend = f.flags & flag::END_STREAM;
+        if (f.flags & flag::END_HEADERS)
+            _onheaders(f.stream, _headerend);
+        else
+            _headerstream = f.stream;
+        break;
+    }
+    case frame_e::CONTINUATION:
+        if (_headerstream == 0)
+            _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+        _fragment.append(_payload);
+        if (f.flags & flag::END_HEADERS) {
+            _headerstream = 0;
+            _onheaders(f.stream, _headerend);
+        }
+        break;
+    case frame_e::RST_STREAM:
+        if (f.stream == 0 || f.length != 4)
+            _fail(except_e::PROTOCOL_ERR, f.stream == 0 ? error_e::PROTOCOL : error_e::FRAME_SIZE);
+        if (s) {
+            // A refused stream was not processed, so any request can be tried again
+            auto error = static_cast<error_e>(be32(payload));
+            if (error == error_e::REFUSED_STREAM && s->attempts < 3)
+                _requeue(*s);
+            else
+                _abort(*s, except_e::STREAM_RESET, error);
+            _flushqueue();
+        }
+        break;
+    case frame_e::SETTINGS:
+        _onsettings(f, payload);
+        break;
+    case frame_e::PUSH_PROMISE:
+        // Push is disabled in our SETTINGS
+        _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+    case frame_e::PING:
+        if (f.stream != 0 || f.length != 8)
+            _fail(except_e::PROTOCOL_ERR, f.stream != 0 ? error_e::PROTOCOL : error_e::FRAME_SIZE);
+        if (f.flags & flag::ACK)
+            _pong = _pong || std::memcmp(payload, &_pingdata, 8) == 0;
+        else
+            _writeframe(frame_e::PING, flag::ACK, 0, payload, 8);
+        break;
+    case frame_e::GOAWAY: {
+        if (f.stream != 0 || f.length < 8)
+            _fail(except_e::PROTOCOL_ERR, f.stream != 0 ? error_e::PROTOCOL : error_e::FRAME_SIZE);
+        _goaway = true;
+        _lastid = be32(payload) & 0x7fffffff;
+
+        // Streams above the last id were never processed, they go out again on the next connection
+        std::vector<stream*> unprocessed;
+        for (auto i = _active.upper_bound(_lastid); i != _active.end(); ++i)
+            unprocessed.push_back(i->second);
+        for (auto i = unprocessed.rbegin(); i != unprocessed.rend(); ++i)
+            _requeue(**i);
+        break;
+    }
+    case frame_e::WINDOW_UPDATE: {
+        if (f.length != 4)
+            _fail(except_e::PROTOCOL_ERR, error_e::FRAME_SIZE);
+        auto increment = be32(payload) & 0x7fffffff;
+        if (f.stream == 0) {
+            _sendwindow += increment;
+            if (increment == 0 || _sendwindow > 0x7fffffff)
+                _fail(except_e::PROTOCOL_ERR, increment == 0 ? error_e::PROTOCOL : error_e::FLOW_CONTROL);
+            for (auto& pair : _active)
+                _writedata(*pair.second);
+        }
+        else if (s) {
+            s->window += increment;
+            _writedata(*s);
+        }
+        break;
+    }
+    default:
+        // PRIORITY and unknown frame types are ignored
+        break;
+    }
+    _con()->flush();
+}
+
+void client::_onheaders(uint32_t id, bool end)
+{
+    // The block has to be decoded even if nobody wants it anymore, it may change the dynamic table
+    http::hpack::fieldlist fields;
+    if (!_decoder.decode(reinterpret_cast<const uint8_t*>(_fragment.data()), _fragment.size(), fields))
+        _fail(except_e::COMPRESSION_ERR, error_e::COMPRESSION);
+    auto it = _active.find(id);
+    if (it == _active.end())
+        return;
+
+    auto& s = *it->second;
+    auto& r = s.response;
+    if (!s.headers_done) {
+        auto status = std::find_if(fields.begin(), fields.end(), [](const auto& f) { return f.first == ":status"; });
+        if (status == fields.end() || status->second.size() != 3 || !std::isdigit(static_cast<unsigned char>(status->second[0]))) {
+            _abort(s, except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+            return;
+        }
+
+        // Informational responses come before the real one
+        auto code = std::stoi(status->second);
+        if (code < 200) {
+            if (end)
+                _abort(s, except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+            return;
+        }
+        r.version = http::version_e::HTTP20;
+        r.status = static_cast<http::status_e>(code);
+        r.reasonphrase.clear();
+        r.header.clear();
+        r.body.clear();
+        r.time.firstbyte = std::chrono::steady_clock::now();
+        r.time.hasinfo = false;
+        if (_http._encryption && _http._unixpath.empty())
+            r.time.handshake = static_cast<tls::client*>(_con())->handshake_time();
+        s.headers_done = true;
+    }
+
+    // Trailers end up with the other headers, repeated fields are joined
+    for (auto& f : fields) {
+        if (f.first[0] == ':')
+            continue;
+        auto& value = r.header[f.first];
+        if (!value.empty())
+            value.append(f.first == "cookie" ? "; " : ", ");
+        value.append(f.second);
+    }
+    if (end)
+        _complete(s);
+}
+
+void client::_onsettings(const frame& f, const uint8_t *payload)
+{
+    if (f.stream != 0)
+        _fail(except_e::PROTOCOL_ERR, error_e::PROTOCOL);
+    if (f.flags & flag::ACK) {
+        if (f.length != 0)
+            _fail(except_e::PROTOCOL_ERR, error_e::FRAME_SIZE);
+        return;
+    }
+    if (f.length % 6 != 0)
+        _fail(except_e::PROTOCOL_ERR, error_e::FRAME_SIZE);
+
+    auto window = _remote.window;
+    auto tablesize = _remote.tablesize;
+    for (uint32_t i = 0; i < f.length; i += 6) {
+        auto id = static_cast<setting_e>((payload[i] << 8) | payload[i+1]);
+        if (!_remote.apply(id, be32(payload+i+2)))
+            _fail(except_e::PROTOCOL_ERR, id == setting_e::INITIAL_WINDOW_SIZE ? error_e::FLOW_CONTROL : error_e::PROTOCOL);
+    }
+
+    // The encoder never grows its table beyond the default, but has to shrink it if the server wants less
+    if (_remote.tablesize != tablesize)
+        _encoder.settablesize(std::min<uint32_t>(_remote.tablesize, 4096));
+    _writeframe(frame_e::SETTINGS, flag::ACK, 0, nullptr, 0);
+
+    // A new initial window changes the window of every open stream by the difference
+    auto delta = static_cast<int64_t>(_remote.window)-window;
+    for (auto& pair : _active) {
+        pair.second->window += delta;
+        _writedata(*pair.second);
+    }
+    _flushqueue();
+}
+
+void client::_requeue(stream& s)
+{
+    _active.erase(s.id);
+    s.id = 0;
+    s.offset = 0;
+    s.received = 0;
+    s.headers_done = false;
+    s.response = http::response();
+    _queued.push_front(&s);
+}
+
+void client::_complete(stream& s)
+{
+    s.done = true;
+    s.response.time.complete = std::chrono::steady_clock::now();
+    _active.erase(s.id);
+    _completed.push_back(s.handle);
+    _flushqueue();
+}
+
+void client::_abort(stream& s, except_e ecode, error_e error)
+{
+    s.failed = true;
+    s.failure = ecode;
+    s.error = error;
+    _complete(s);
+}
+
+void client::_lost()
+{
+    std::vector<stream*> streams;
+    for (auto& pair : _active)
+        streams.push_back(pair.second);
+    _con()->close();
+
+    // Requests the server didn't process, or GET and HEAD without any response yet, are sent again
+    for (auto i = streams.rbegin(); i != streams.rend(); ++i) {
+        auto& s = **i;
+        bool unprocessed = _goaway && s.id > _lastid;
+        if ((unprocessed || (idempotent(s.method) && !s.headers_done)) && s.attempts < 3)
+            _requeue(s);
+        else
+            _abort(s, except_e::CONNECTION_LOST, error_e::NONE);
+    }
+}
+
+void client::_fail(except_e ecode, error_e error)
+{
+    // The server never opens streams (push is disabled), so the last processed stream is always 0
+    uint8_t payload[8];
+    put32(payload, 0);
+    put32(payload+4, static_cast<uint32_t>(error));
+    try {
+        _writeframe(frame_e::GOAWAY, 0, 0, payload, sizeof(payload));
+        _con()->flush();
+    }
+    catch (...) {
+    }
+    _con()->close();
+
+    std::vector<stream*> streams;
+    for (auto& pair : _active)
+        streams.push_back(pair.second);
+    for (auto s : streams)
+        _abort(*s, ecode, error);
+    throw exception(ecode, error);
+}
\ No newline at end of file
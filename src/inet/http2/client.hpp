@@ -0,0 +1,193 @@
+#pragma once
+
+#include "../http/client.hpp"
+#include "../http/hpack.hpp"
+#include "types.hpp"
+#include <map>
+
+namespace inet::http2
+{
+    // Multiplexes requests to one origin over a single connection. Send as many requests as needed, they get their
+    // own streams (up to what the server allows, the rest waits) and the responses can be retrieved in any order.
+    // Response header names are lower case, as HTTP/2 sends them. Not thread safe.
+    class client
+    {
+    public:
+
+        client() = delete;
+
+        client(const client& rhs) = delete;
+
+        client(std::string_view host, bool encryption = true);
+
+        ~client();
+
+        bool isconnected() const;
+
+        // Uses this TLS context instead of the process wide default, nullptr goes back to the default
+        client& settlscontext(std::shared_ptr<tls::context> ctx);
+
+        // Resolves the host through the cache (owned by the caller), nullptr disables it
+        client& setdnscache(tcp::dnscache *cache);
+
+        // Connects through a unix domain socket instead (prior knowledge, no TLS), an empty path goes back to TCP
+        client& setunixpath(std::string_view path);
+
+        // How much response data the server may send before it has to wait for us, per stream and per connection.
+        // Takes effect on the next connection.
+        client& setwindow(uint32_t stream, uint32_t connection);
+
+        // Connects to the server, over TLS the server has to pick h2 through ALPN, without it the server has to
+        // accept HTTP/2 with prior knowledge
+        client& connect();
+
+        // Sends GOAWAY and disconnects, requests that didn't complete are dropped
+        client& disconnect();
+
+        // Starts a request and returns the handle to retrieve its response with, (re)connects if needed
+        uint32_t send(http::method_e m, std::string_view r, const char *data = nullptr, unsigned int size = 0);
+
+        uint32_t send(const http::message& m);
+
+        // Waits for the response to the request, throws if the server reset the stream
+        client& retrieve(uint32_t request, http::response& r);
+
+        // Waits for whichever outstanding request completes first and returns its handle
+        uint32_t retrieve(http::response& r);
+
+        // Sends a PING and waits for the acknowledgement, returns the round trip time
+        std::chrono::microseconds ping();
+
+        // Requests that have been sent but not retrieved yet
+        size_t pending() const noexcept;
+
+        // How many streams the server allows at once
+        uint32_t maxstreams() const noexcept;
+
+    private:
+
+        struct stream
+        {
+            uint32_t handle;
+
+            uint32_t id = 0;
+
+            http::method_e method;
+
+            http::hpack::fieldlist headers;
+
+            // The request body, it's kept until the stream completes so it can be sent again
+            std::string data;
+
+            size_t offset = 0;
+
+            // Send window, the server can make it negative by shrinking the initial window
+            int64_t window = 0;
+
+            // Response data that has not been acknowledged with a WINDOW_UPDATE yet
+            uint32_t received = 0;
+
+            unsigned int attempts = 0;
+
+            bool headers_done = false;
+
+            bool done = false;
+
+            bool failed = false;
+
+            except_e failure;
+
+            error_e error = error_e::NONE;
+
+            http::response response;
+        };
+
+        tcp::client * _con() const;
+
+        void _open();
+
+        // Gives the queued requests a stream as long as the server allows more streams
+        void _flushqueue();
+
+        void _writeframe(frame_e type, uint8_t flags, uint32_t id, const void *payload, size_t len);
+
+        void _writeheaders(stream& s);
+
+        // Sends as much of the request body as the flow control windows allow
+        void _writedata(stream& s);
+
+        void _windowupdate(uint32_t id, uint32_t increment);
+
+        // Reads and handles one frame, reconnects first when the old connection is done
+        void _step();
+
+        void _readframe();
+
+        void _onheaders(uint32_t id, bool end);
+
+        void _onsettings(const frame& f, const uint8_t *payload);
+
+        // Moves the stream back into the queue so it's sent again, possibly over a new connection
+        void _requeue(stream& s);
+
+        // The response is complete, the stream's slot can be used by a queued request
+        void _complete(stream& s);
+
+        // Ends a stream without a response, retrieving it throws
+        void _abort(stream& s, except_e ecode, error_e error);
+
+        // The connection broke or the server closed it, unprocessed requests get sent again over a new connection
+        void _lost();
+
+        // Connection error: tells the server with GOAWAY, closes the connection and throws
+        [[noreturn]] void _fail(except_e ecode, error_e error);
+
+        http::client _http;
+
+        settings _local;
+
+        settings _remote;
+
+        uint32_t _connwindow = 16*1024*1024;
+
+        int64_t _sendwindow = 65535;
+
+        uint32_t _received = 0;
+
+        uint32_t _nextid = 1;
+
+        uint32_t _nextrequest = 1;
+
+        // Set after GOAWAY, the connection only finishes what it has
+        bool _goaway = false;
+
+        uint32_t _lastid = 0;
+
+        // A header block split over HEADERS and CONTINUATION frames
+        uint32_t _headerstream = 0;
+
+        bool _headerend = false;
+
+        std::string _fragment;
+
+        std::string _payload;
+
+        uint64_t _pingdata = 0;
+
+        bool _pong = false;
+
+        http::hpack::decoder _decoder;
+
+        http::hpack::encoder _encoder;
+
+        // All requests by handle, the ones with an open stream by stream id and the ones waiting for a stream
+        std::map<uint32_t, stream> _requests;
+
+        std::map<uint32_t, stream*> _active;
+
+        std::deque<stream*> _queued;
+
+        // Handles in the order their responses completed, for retrieving whichever is done first
+        std::deque<uint32_t> _completed;
+    };
+}
\ No newline at end of file
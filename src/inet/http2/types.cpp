@@ -0,0 +1,115 @@
+#include "types.hpp"
+
+using namespace inet::http2;
+
+exception::exception(except_e ecode, error_e error)
+    : ecode(ecode), error(error)
+{
+}
+
+const char * exception::what() const noexcept
+{
+    switch (ecode) {
+    case except_e::OPEN_FAIL:
+        return "Failed to connect to the server";
+    case except_e::NO_H2:
+        return "The server does not speak HTTP/2";
+    case except_e::PROTOCOL_ERR:
+        return "HTTP/2 protocol error";
+    case except_e::COMPRESSION_ERR:
+        return "Invalid HPACK header block";
+    case except_e::STREAM_RESET:
+        return "The stream was reset";
+    case except_e::CONNECTION_LOST:
+        return "The connection was lost before the response arrived";
+    default:
+        return "Unkown error occurred";
+    }
+}
+
+void frame::encode(uint8_t *out) const
+{
+    out[0] = static_cast<uint8_t>(length >> 16);
+    out[1] = static_cast<uint8_t>(length >> 8);
+    out[2] = static_cast<uint8_t>(length);
+    out[3] = static_cast<uint8_t>(type);
+    out[4] = flags;
+    out[5] = static_cast<uint8_t>(stream >> 24) & 0x7f;
+    out[6] = static_cast<uint8_t>(stream >> 16);
+    out[7] = static_cast<uint8_t>(stream >> 8);
+    out[8] = static_cast<uint8_t>(stream);
+}
+
+void frame::decode(const uint8_t *in)
+{
+    length = (in[0] << 16) | (in[1] << 8) | in[2];
+    type = static_cast<frame_e>(in[3]);
+    flags = in[4];
+    stream = ((in[5] & 0x7f) << 24) | (in[6] << 16) | (in[7] << 8) | in[8];
+}
+
+bool settings::apply(setting_e id, uint32_t value)
+{
+    switch (id) {
+    case setting_e::HEADER_TABLE_SIZE:
+        tablesize = value;
+        return true;
+    case setting_e::ENABLE_PUSH:
+        push = value == 1;
+        return value <= 1;
+    case setting_e::MAX_CONCURRENT_STREAMS:
+        maxstreams = value;
+        return true;
+    case setting_e::INITIAL_WINDOW_SIZE:
+        window = value;
+        return value <= 0x7fffffff;
+    case setting_e::MAX_FRAME_SIZE:
+        framesize = value;
+        return value >= 16384 && value <= 0xffffff;
+    case setting_e::MAX_HEADER_LIST_SIZE:
+        headerlist = value;
+        return true;
+    default:
+        // Unknown settings are ignored
+        return true;
+    }
+}
+
+namespace std
+{
+    string to_string(error_e error)
+    {
+        switch (error) {
+        case error_e::NONE:
+            return "NO_ERROR";
+        case error_e::PROTOCOL:
+            return "PROTOCOL_ERROR";
+        case error_e::INTERNAL:
+            return "INTERNAL_ERROR";
+        case error_e::FLOW_CONTROL:
+            return "FLOW_CONTROL_ERROR";
+        case error_e::SETTINGS_TIMEOUT:
+            return "SETTINGS_TIMEOUT";
+        case error_e::STREAM_CLOSED:
+            return "STREAM_CLOSED";
+        case error_e::FRAME_SIZE:
+            return "FRAME_SIZE_ERROR";
+        case error_e::REFUSED_STREAM:
+            return "REFUSED_STREAM";
+        case error_e::CANCEL:
+            return "CANCEL";
+        case error_e::COMPRESSION:
+            return "COMPRESSION_ERROR";
+        case error_e::CONNECT:
+            return "CONNECT_ERROR";
+        case error_e::ENHANCE_YOUR_CALM:
+            return "ENHANCE_YOUR_CALM";
+        case error_e::INADEQUATE_SECURITY:
+            return "INADEQUATE_SECURITY";
+        case error_e::HTTP_1_1_REQUIRED:
+            return "HTTP_1_1_REQUIRED";
+        default:
+            return to_string(underlying_type_t<error_e>(error));
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <exception>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace inet::http2
+{
+    enum class except_e { OPEN_FAIL, NO_H2, PROTOCOL_ERR, COMPRESSION_ERR, STREAM_RESET, CONNECTION_LOST };
+
+    // Error codes carried by RST_STREAM and GOAWAY (RFC 7540 section 7)
+    enum class error_e : uint32_t {
+        NONE = 0x0, PROTOCOL = 0x1, INTERNAL = 0x2, FLOW_CONTROL = 0x3, SETTINGS_TIMEOUT = 0x4, STREAM_CLOSED = 0x5,
+        FRAME_SIZE = 0x6, REFUSED_STREAM = 0x7, CANCEL = 0x8, COMPRESSION = 0x9, CONNECT = 0xa, ENHANCE_YOUR_CALM = 0xb,
+        INADEQUATE_SECURITY = 0xc, HTTP_1_1_REQUIRED = 0xd
+    };
+
+    class exception : public std::exception
+    {
+    public:
+
+        exception(except_e ecode, error_e error = error_e::NONE);
+
+        const char * what() const noexcept override;
+
+        const except_e ecode;
+
+        // What the peer (or this side) reported, if anything
+        const error_e error;
+    };
+
+    enum class frame_e : uint8_t { DATA, HEADERS, PRIORITY, RST_STREAM, SETTINGS, PUSH_PROMISE, PING, GOAWAY, WINDOW_UPDATE, CONTINUATION };
+
+    // Frame flags, which ones apply depends on the frame type
+    namespace flag
+    {
+        constexpr uint8_t END_STREAM = 0x1;
+        constexpr uint8_t ACK = 0x1;
+        constexpr uint8_t END_HEADERS = 0x4;
+        constexpr uint8_t PADDED = 0x8;
+        constexpr uint8_t PRIORITY = 0x20;
+    }
+
+    enum class setting_e : uint16_t { HEADER_TABLE_SIZE = 1, ENABLE_PUSH, MAX_CONCURRENT_STREAMS, INITIAL_WINDOW_SIZE, MAX_FRAME_SIZE, MAX_HEADER_LIST_SIZE };
+
+    // The 9 byte header in front of every frame
+    struct frame
+    {
+        uint32_t length;
+
+        frame_e type;
+
+        uint8_t flags;
+
+        uint32_t stream;
+
+        static constexpr size_t size = 9;
+
+        void encode(uint8_t *out) const;
+
+        void decode(const uint8_t *in);
+    };
+
+    // One side's SETTINGS, starting out with the protocol defaults
+    struct settings
+    {
+        uint32_t tablesize = 4096;
+
+        bool push = true;
+
+        uint32_t maxstreams = UINT32_MAX;
+
+        uint32_t window = 65535;
+
+        uint32_t framesize = 16384;
+
+        uint32_t headerlist = UINT32_MAX;
+
+        // Applies a single setting, returns false if the value is out of range
+        bool apply(setting_e id, uint32_t value);
+    };
+}
+
+namespace std
+{
+    string to_string(inet::http2::error_e error);
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "runtime.hpp"
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace inet;
+
+static thread_local runtime::shard *current_shard = nullptr;
+
+/*
+ * Shard class
+ */
+runtime::shard::shard(unsigned int id, const tls::context::options& tlsoptions)
+	: _id(id), _tlsoptions(tlsoptions)
+{
+	// The queue always contains a stub node so producers never touch the tail
+	_tail = new node;
+	_tail->next = nullptr;
+	_head = _tail;
+}
+
+runtime::shard::~shard()
+{
+	task_t task;
+	while (_pop(task));
+	delete _tail;
+}
+
+unsigned int runtime::shard::id() const noexcept
+{
+	return _id;
+}
+
+void runtime::shard::post(task_t task)
+{
+	auto n = new node;
+	n->next.store(nullptr, std::memory_order_relaxed);
+	n->task = std::move(task);
+
+	// Publish the node, sequentially consistent so it can't pass the sleeping check below
+	auto prev = _head.exchange(n);
+	prev->next.store(n);
+
+	// Only take the lock if the shard might be waiting for work
+	if (_sleeping.load()) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_cv.notify_one();
+	}
+}
+
+tcp::dnscache& runtime::shard::dns() noexcept
+{
+	return _dns;
+}
+
+std::shared_ptr<tls::context> runtime::shard::tlscontext()
+{
+	if (!_tls)
+		_tls = tls::context::create(_tlsoptions);
+	return _tls;
+}
+
+uint64_t runtime::shard::executed() const noexcept
+{
+	return _executed;
+}
+
+bool runtime::shard::_pop(task_t& task)
+{
+	auto next = _tail->next.load(std::memory_order_acquire);
+	if (next == nullptr)
+		return false;
+
+	// The popped node becomes the new stub
+	task = std::move(next->task);
+	delete _tail;
+	_tail = next;
+	return true;
+}
+
+void runtime::shard::_run(bool pin)
+{
+#ifdef __linux__
+	if (pin) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(_id % std::max(std::thread::hardware_concurrency(), 1U), &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+#endif
+	current_shard = this;
+
+	task_t task;
+	while (true) {
+		while (_pop(task)) {
+			task();
+			task = nullptr;
+			_executed.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Go to sleep, the queue is checked again after announcing it so a concurrent post can't be missed
+		std::unique_lock<std::mutex> lock(_mutex);
+		_sleeping.store(true);
+		_cv.wait(lock, [this]() { return _tail->next.load() != nullptr || _stop.load(); });
+		_sleeping.store(false);
+		if (_tail->next.load() == nullptr && _stop.load())
+			break;
+	}
+
+	_locals.clear();
+	_tls.reset();
+	current_shard = nullptr;
+}
+
+/*
+ * Runtime class
+ */
+runtime::runtime(unsigned int shards, bool pin, const tls::context::options& tlsoptions)
+{
+	for (unsigned int i = 0; i < std::max(shards, 1U); ++i)
+		_shards.push_back(new shard(i, tlsoptions));
+	for (auto s : _shards)
+		s->_thread = std::thread(&shard::_run, s, pin);
+}
+
+runtime::~runtime()
+{
+	stop();
+	for (auto s : _shards)
+		delete s;
+}
+
+unsigned int runtime::size() const noexcept
+{
+	return static_cast<unsigned int>(_shards.size());
+}
+
+runtime::shard& runtime::at(unsigned int i)
+{
+	return *_shards.at(i);
+}
+
+void runtime::post(unsigned int shard, task_t task)
+{
+	_shards.at(shard)->post(std::move(task));
+}
+
+runtime::shard * runtime::current() noexcept
+{
+	return current_shard;
+}
+
+void runtime::stop()
+{
+	for (auto s : _shards) {
+		std::lock_guard<std::mutex> lock(s->_mutex);
+		s->_stop = true;
+		s->_cv.notify_one();
+	}
+	for (auto s : _shards) {
+		if (s->_thread.joinable())
+			s->_thread.join();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "../tcp/dnscache.hpp"
+#include "../tls/tlsclient.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+namespace inet
+{
+	// Shared-nothing runtime: every shard is a thread (pinned to a core) that owns the connections created on it together
+	// with its own caches. Other threads hand work to a shard through a lock-free queue instead of sharing state.
+	class runtime
+	{
+	public:
+
+		typedef std::function<void()> task_t;
+
+		class shard
+		{
+			friend runtime;
+
+		public:
+
+			shard(const shard& rhs) = delete;
+
+			~shard();
+
+			unsigned int id() const noexcept;
+
+			// Queues a task on this shard, can be called from any thread
+			void post(task_t task);
+
+			// Name lookups for clients living on this shard (only use it from the shard itself)
+			tcp::dnscache& dns() noexcept;
+
+			// TLS context for clients living on this shard, so their session cache isn't shared with other shards.
+			// Created from the runtime's options on first use (only use it from the shard itself).
+			std::shared_ptr<tls::context> tlscontext();
+
+			// Per shard instance of T, created on first use (only use it from the shard itself)
+			template<typename T>
+			T& local();
+
+			// Number of tasks that have been run
+			uint64_t executed() const noexcept;
+
+		private:
+
+			struct node
+			{
+				std::atomic<node*> next;
+
+				task_t task;
+			};
+
+			shard(unsigned int id, const tls::context::options& tlsoptions);
+
+			void _run(bool pin);
+
+			bool _pop(task_t& task);
+
+			unsigned int _id;
+
+			// Multiple producer single consumer queue, producers swap the head and the shard pops at the tail
+			alignas(64) std::atomic<node*> _head;
+			alignas(64) node *_tail;
+
+			// Only touched when the shard goes idle
+			std::atomic<bool> _sleeping = false;
+			std::atomic<bool> _stop = false;
+			std::mutex _mutex;
+			std::condition_variable _cv;
+
+			std::atomic<uint64_t> _executed = 0;
+
+			tcp::dnscache _dns;
+
+			tls::context::options _tlsoptions;
+
+			std::shared_ptr<tls::context> _tls;
+
+			std::unordered_map<std::type_index, std::shared_ptr<void>> _locals;
+
+			std::thread _thread;
+		};
+
+		// Starts the shards, shard i is pinned to core i (modulo the number of cores) when pin is set. Every shard
+		// creates its TLS context from tlsoptions.
+		runtime(unsigned int shards = std::thread::hardware_concurrency(), bool pin = true,
+			const tls::context::options& tlsoptions = tls::context::options());
+
+		runtime(const runtime& rhs) = delete;
+
+		// Runs the remaining tasks and stops every shard
+		~runtime();
+
+		unsigned int size() const noexcept;
+
+		shard& at(unsigned int i);
+
+		void post(unsigned int shard, task_t task);
+
+		// The shard the calling thread belongs to, nullptr outside of the runtime
+		static shard * current() noexcept;
+
+		void stop();
+
+	private:
+
+		std::vector<shard*> _shards;
+	};
+
+	template<typename T>
+	inline T& runtime::shard::local()
+	{
+		auto& ptr = _locals[std::type_index(typeid(T))];
+		if (!ptr)
+			ptr = std::make_shared<T>();
+		return *static_cast<T*>(ptr.get());
+	}
+}
\ No newline at end of file
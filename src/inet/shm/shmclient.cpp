@@ -0,0 +1,453 @@
+#include "shmclient.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+using namespace inet::shm;
+
+/*
+ * Shared memory layout, the creator writes to the first ring and reads from the second
+ */
+static constexpr uint32_t layout_magic = 0x53484d31; // SHM1
+
+static constexpr size_t layout_header = 4096;
+
+namespace inet::shm
+{
+	struct ring
+	{
+		// Advanced by the producer and consumer respectively, kept on separate cache lines
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+
+		// Bumped after data was produced or consumed, sleepers wait on these
+		alignas(64) std::atomic<uint32_t> dataseq;
+		std::atomic<uint32_t> datawaiters;
+		alignas(64) std::atomic<uint32_t> spaceseq;
+		std::atomic<uint32_t> spacewaiters;
+
+		// Set when the producer or the consumer went away
+		alignas(64) std::atomic<uint32_t> wclosed;
+		std::atomic<uint32_t> rclosed;
+	};
+
+	struct layout
+	{
+		uint32_t magic;
+		uint32_t capacity;
+		ring rings[2];
+	};
+
+	struct endpoint
+	{
+		ring *in;
+		ring *out;
+		char *indata;
+		char *outdata;
+		uint64_t capacity;
+	};
+
+	static_assert(sizeof(layout) <= layout_header);
+}
+
+/*
+ * Futex helpers, the words are shared between processes so the private variants can't be used
+ */
+static bool futex_wait(std::atomic<uint32_t>& word, uint32_t old, int timeout)
+{
+#ifdef __linux__
+	timespec ts = { timeout / 1000, (timeout % 1000) * 1000000L };
+	auto ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, old, timeout >= 0 ? &ts : nullptr, nullptr, 0);
+	return ret == 0 || errno != ETIMEDOUT;
+#else
+	std::this_thread::yield();
+	return true;
+#endif
+}
+
+static void futex_wake(std::atomic<uint32_t>& word)
+{
+#ifdef __linux__
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+static void notify(std::atomic<uint32_t>& seq, std::atomic<uint32_t>& waiters)
+{
+	seq.fetch_add(1);
+	if (waiters.load() != 0)
+		futex_wake(seq);
+}
+
+/*
+ * Exception class
+ */
+#ifndef INET_SHM_DISABLE_CUSTOM_EXCEPTION
+exception::exception(except_e ecode)
+	: ecode(ecode)
+{
+}
+
+const char * exception::what() const noexcept
+{
+	switch (ecode) {
+	case except_e::CREATE:
+		return "Failed to create shared memory";
+	case except_e::OPEN:
+		return "Failed to open shared memory";
+	case except_e::MAP:
+		return "Failed to map shared memory";
+	case except_e::LAYOUT:
+		return "Shared memory does not contain a ring pair";
+	case except_e::WAIT:
+		return "Failed to wait for the peer";
+	default:
+		return "Unkown error occurred";
+	}
+}
+#endif
+
+/*
+ * Streambuf class
+ */
+streambuf::streambuf()
+	: gstreambuf()
+{
+}
+
+streambuf::~streambuf()
+{
+	try {
+		this->pubsync();
+	} catch (...) {}
+}
+
+void streambuf::set_spin(std::chrono::microseconds spin)
+{
+	_spin = spin;
+}
+
+bool streambuf::wait(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiters, uint32_t old)
+{
+	// Spin first, handing over through the cache is much cheaper than a sleep and a wake up
+	auto spinend = std::chrono::steady_clock::now() + _spin;
+	while (word.load(std::memory_order_acquire) == old) {
+		if (std::chrono::steady_clock::now() >= spinend)
+			break;
+	}
+	if (word.load() != old)
+		return true;
+
+	// Sleep until the peer bumps the word or the timeout expires
+	int timeleft = std::max(_duration - std::chrono::duration_cast<milisecond>(std::chrono::high_resolution_clock::now()-_begin).count(), 0);
+	if (_duration > 0 && timeleft == 0)
+		return false;
+	waiters.fetch_add(1);
+	auto ret = futex_wait(word, old, _duration > 0 ? timeleft : -1);
+	waiters.fetch_sub(1);
+	return ret;
+}
+
+void streambuf::readfunc(const void * const t, size_t& res, char *begin, size_t len)
+{
+	auto ep = *static_cast<endpoint * const *>(t);
+	auto in = ep->in;
+
+	// Check the size limit
+	if (_inlimit && _curread >= _maxread)
+		return;
+
+	while (true) {
+		// The sequence has to be read before the head, otherwise a wake up could be missed
+		auto seq = in->dataseq.load();
+		auto tail = in->tail.load(std::memory_order_relaxed);
+		auto head = in->head.load();
+
+		if (head != tail) {
+			// Copy the data out of the ring, it might wrap around. A head that's further ahead than the ring is large
+			// can only come from a broken peer, it's capped so the copy stays inside the ring.
+			size_t n = std::min<uint64_t>(len, std::min<uint64_t>(head-tail, ep->capacity));
+			auto pos = tail & (ep->capacity-1);
+			auto first = std::min<uint64_t>(n, ep->capacity-pos);
+			std::memcpy(begin, ep->indata+pos, first);
+			std::memcpy(begin+first, ep->indata, n-first);
+			in->tail.store(tail+n);
+			notify(in->spaceseq, in->spacewaiters);
+
+			// Update limits
+			res += n;
+			_curread += n;
+			_begin = std::chrono::high_resolution_clock::now();
+			return;
+		}
+
+		// Nothing left and nothing coming
+		if (in->wclosed.load() != 0)
+			return;
+
+		if (!wait(in->dataseq, in->datawaiters, seq))
+			return;
+	}
+}
+
+void streambuf::writefunc(const void * const t, size_t& res, char *begin, size_t len)
+{
+	auto ep = *static_cast<endpoint * const *>(t);
+	auto out = ep->out;
+
+	while (true) {
+		// A reader that went away will never make room again
+		if (out->rclosed.load() != 0)
+			return;
+
+		auto seq = out->spaceseq.load();
+		auto head = out->head.load(std::memory_order_relaxed);
+		auto tail = out->tail.load();
+
+		if (head-tail < ep->capacity) {
+			// Copy as much as fits into the ring, it might wrap around
+			size_t n = std::min<uint64_t>(len, ep->capacity-(head-tail));
+			auto pos = head & (ep->capacity-1);
+			auto first = std::min<uint64_t>(n, ep->capacity-pos);
+			std::memcpy(ep->outdata+pos, begin, first);
+			std::memcpy(ep->outdata, begin+first, n-first);
+			out->head.store(head+n);
+			notify(out->dataseq, out->datawaiters);
+			res += n;
+			return;
+		}
+
+		if (!wait(out->spaceseq, out->spacewaiters, seq))
+			return;
+	}
+}
+
+/*
+ * Client class
+ */
+client::client()
+{
+}
+
+client::~client()
+{
+	_disconnect();
+}
+
+bool client::is_open() const noexcept
+{
+	return _connected;
+}
+
+void client::open(std::string_view node, std::string_view service)
+{
+	_disconnect();
+
+#ifdef __linux__
+	_name.clear();
+	auto fd = shm_open(std::string(node).c_str(), O_RDWR | O_CLOEXEC, 0);
+	if (fd < 0) {
+#ifndef INET_SHM_DISABLE_CUSTOM_EXCEPTION
+		throw exception(except_e::OPEN);
+#else
+		this->setstate(std::ios_base::badbit);
+		return;
+#endif
+	}
+	_map(fd, false, 0);
+#else
+	this->setstate(std::ios_base::badbit);
+#endif
+}
+
+void client::open(int fd)
+{
+	_disconnect();
+
+#ifdef __linux__
+	_name.clear();
+	auto dup = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (dup < 0) {
+#ifndef INET_SHM_DISABLE_CUSTOM_EXCEPTION
+		throw exception(except_e::OPEN);
+#else
+		this->setstate(std::ios_base::badbit);
+		return;
+#endif
+	}
+	_map(dup, false, 0);
+#else
+	this->setstate(std::ios_base::badbit);
+#endif
+}
+
+void client::create(std::string_view name, size_t capacity)
+{
+	_disconnect();
+
+#ifdef __linux__
+	// The ring indices are masked, so the capacity has to be a power of two
+	size_t rounded = 4096;
+	while (rounded < capacity && rounded < (1U << 31))
+		rounded <<= 1;
+
+	int fd;
+	if (name.empty())
+		fd = memfd_create("inet-shm", MFD_CLOEXEC);
+	else
+		fd = shm_open(std::string(name).c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0 || ftruncate(fd, layout_header + 2*rounded) < 0) {
+		if (fd >= 0) {
+			::close(fd);
+			if (!name.empty())
+				shm_unlink(std::string(name).c_str());
+		}
+#ifndef INET_SHM_DISABLE_CUSTOM_EXCEPTION
+		throw exception(except_e::CREATE);
+#else
+		this->setstate(std::ios_base::badbit);
+		return;
+#endif
+	}
+
+	// The creator removes the name again when it closes
+	_name = name;
+	_map(fd, true, rounded);
+#else
+	this->setstate(std::ios_base::badbit);
+#endif
+}
+
+void client::close()
+{
+	_disconnect();
+}
+
+int client::fd() const noexcept
+{
+	return _fd;
+}
+
+void client::set_spin(std::chrono::microseconds spin)
+{
+	if (_sb == nullptr)
+		_createsb();
+	static_cast<streambuf*>(_sb)->set_spin(spin);
+}
+
+const char * client::getprotocol()
+{
+	if (_connected)
+		return "SHM";
+	else
+		return "Not connected";
+}
+
+void client::_createsb()
+{
+	// The base class deletes this value
+	_sb = new streambuf();
+	this->set_rdbuf(_sb);
+	this->clear();
+}
+
+void client::_map(int fd, bool creator, size_t capacity)
+{
+#ifdef __linux__
+	auto error_handling = [this, fd](except_e except) {
+		::close(fd);
+		if (!_name.empty())
+			shm_unlink(_name.c_str());
+		_name.clear();
+#ifndef INET_SHM_DISABLE_CUSTOM_EXCEPTION
+		throw exception(except);
+#else
+		this->setstate(std::ios_base::badbit);
+#endif
+	};
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < layout_header)
+		return error_handling(except_e::LAYOUT);
+
+	auto mem = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+		return error_handling(except_e::MAP);
+
+	// Fresh memory is zeroed, which is a valid empty state for every ring
+	auto l = static_cast<layout*>(mem);
+	if (creator) {
+		l->capacity = static_cast<uint32_t>(capacity);
+		std::atomic_thread_fence(std::memory_order_release);
+		reinterpret_cast<std::atomic<uint32_t>*>(&l->magic)->store(layout_magic);
+	}
+
+	// The peer's header is read once (after the magic) and not trusted, the capacity is used as a mask so it has to
+	// be a power of two
+	auto cap = static_cast<uint32_t>(capacity);
+	if (!creator) {
+		bool valid = reinterpret_cast<std::atomic<uint32_t>*>(&l->magic)->load() == layout_magic;
+		cap = l->capacity;
+		if (!valid || cap == 0 || (cap & (cap-1)) != 0 || layout_header + 2*static_cast<size_t>(cap) > static_cast<size_t>(st.st_size)) {
+			munmap(mem, st.st_size);
+			return error_handling(except_e::LAYOUT);
+		}
+	}
+
+	_fd = fd;
+	_mem = mem;
+	_size = st.st_size;
+
+	auto data = static_cast<char*>(mem) + layout_header;
+	_ep = new endpoint;
+	_ep->capacity = cap;
+	_ep->out = &l->rings[creator ? 0 : 1];
+	_ep->in = &l->rings[creator ? 1 : 0];
+	_ep->outdata = data + (creator ? 0 : cap);
+	_ep->indata = data + (creator ? cap : 0);
+
+	if (_sb == nullptr)
+		_createsb();
+	_sb->reset(_ep);
+	this->clear();
+	_connected = true;
+#endif
+}
+
+void client::_disconnect()
+{
+#ifdef __linux__
+	if (_connected) {
+		// Push out what is left and tell the peer we're gone, in both directions
+		try {
+			this->flush();
+		} catch (...) {}
+		_ep->out->wclosed.store(1);
+		notify(_ep->out->dataseq, _ep->out->datawaiters);
+		_ep->in->rclosed.store(1);
+		notify(_ep->in->spaceseq, _ep->in->spacewaiters);
+
+		_sb->reset();
+		this->clear();
+		delete _ep;
+		_ep = nullptr;
+		munmap(_mem, _size);
+		::close(_fd);
+		_fd = -1;
+		if (!_name.empty())
+			shm_unlink(_name.c_str());
+		_name.clear();
+		_connected = false;
+	}
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <exception>
+#include <cstdint>
+#include <atomic>
+#include "../gconnection.hpp"
+
+// If for some inane reason you don't want to use exception handling or want to use standard library exceptions
+//#define INET_SHM_DISABLE_CUSTOM_EXCEPTION
+
+namespace inet::shm
+{
+	enum class except_e { CREATE, OPEN, MAP, LAYOUT, WAIT };
+
+#ifndef INET_SHM_DISABLE_CUSTOM_EXCEPTION
+	class exception : public std::exception
+	{
+	public:
+
+		exception(except_e ecode);
+
+		const char * what() const noexcept override;
+
+		const except_e ecode;
+	};
+#endif
+
+	// One side of a mapped ring pair, the layout itself is private to the implementation
+	struct endpoint;
+
+	// Streambuf over two single producer single consumer rings in shared memory
+	class streambuf : public gstreambuf<char>
+	{
+	public:
+
+		streambuf();
+
+		~streambuf();
+
+		// Busy-wait this long before sleeping when the peer isn't ready (off by default, only useful with a core to spare)
+		void set_spin(std::chrono::microseconds spin);
+
+	protected:
+
+		using typename gstreambuf<char>::milisecond;
+
+		// Waits until the word changes from its old value, returns false on timeout
+		bool wait(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiters, uint32_t old);
+
+		void readfunc(const void * const t, size_t& res, char *begin, size_t len) override;
+
+		void writefunc(const void * const t, size_t& res, char *begin, size_t len) override;
+
+		std::chrono::microseconds _spin = std::chrono::microseconds(0);
+	};
+
+	// Connection to a process on the same host through shared memory (linux only)
+	class client : public gconnection<char>
+	{
+	public:
+
+		client();
+
+		~client();
+
+		bool is_open() const noexcept override;
+
+		// Attaches to a ring pair that the peer created, the node is the name of the shared memory object
+		void open(std::string_view node, std::string_view service = "") override;
+
+		// Attaches to a ring pair through a descriptor received from the peer (the descriptor is duplicated)
+		void open(int fd);
+
+		// Creates a ring pair with capacity bytes per direction (rounded up to a power of two), an empty name
+		// creates an anonymous memfd which can be passed to the peer through fd()
+		void create(std::string_view name, size_t capacity = 1024*1024);
+
+		void close() override;
+
+		int fd() const noexcept;
+
+		void set_spin(std::chrono::microseconds spin);
+
+		const char * getprotocol() override;
+
+	private:
+
+		void _createsb();
+
+		void _map(int fd, bool creator, size_t capacity);
+
+		void _disconnect();
+
+		int _fd = -1;
+
+		void *_mem = nullptr;
+
+		size_t _size = 0;
+
+		std::string _name;
+
+		endpoint *_ep = nullptr;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "dnscache.hpp"
+
+#if (defined _WIN32 || defined WIN32)
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
+using namespace inet::tcp;
+
+dnscache::dnscache(std::chrono::seconds ttl, size_t capacity)
+	: _ttl(ttl), _capacity(capacity)
+{
+}
+
+dnscache::~dnscache()
+{
+	clear();
+}
+
+const addrinfo * dnscache::resolve(std::string_view node, std::string_view service, int& error)
+{
+	auto now = std::chrono::steady_clock::now();
+	auto key = std::string(node).append(1, '\0').append(service);
+
+	// Serve from the cache while the entry is fresh
+	auto it = _entries.find(key);
+	if (it != _entries.end()) {
+		if (it->second.expires > now) {
+			++_hits;
+			error = 0;
+			return it->second.info;
+		}
+		freeaddrinfo(it->second.info);
+		_entries.erase(it);
+	}
+	++_misses;
+
+	addrinfo hints = {}, *info;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	error = getaddrinfo(std::string(node).c_str(), std::string(service).c_str(), &hints, &info);
+	if (error != 0)
+		return nullptr;
+
+	// Make room by dropping expired entries first, and an arbitrary one if that wasn't enough
+	if (_entries.size() >= _capacity) {
+		for (auto i = _entries.begin(); i != _entries.end();) {
+			if (i->second.expires <= now) {
+				freeaddrinfo(i->second.info);
+				i = _entries.erase(i);
+			}
+			else
+				++i;
+		}
+		if (_entries.size() >= _capacity && !_entries.empty()) {
+			freeaddrinfo(_entries.begin()->second.info);
+			_entries.erase(_entries.begin());
+		}
+	}
+
+	_entries[key] = { info, now + _ttl };
+	return info;
+}
+
+void dnscache::invalidate(std::string_view node, std::string_view service)
+{
+	auto it = _entries.find(std::string(node).append(1, '\0').append(service));
+	if (it != _entries.end()) {
+		freeaddrinfo(it->second.info);
+		_entries.erase(it);
+	}
+}
+
+void dnscache::clear()
+{
+	for (auto& pair : _entries)
+		freeaddrinfo(pair.second.info);
+	_entries.clear();
+}
+
+uint64_t dnscache::hits() const noexcept
+{
+	return _hits;
+}
+
+uint64_t dnscache::misses() const noexcept
+{
+	return _misses;
+}
\ No newline at end of file
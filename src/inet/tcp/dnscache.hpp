@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <string_view>
+
+struct addrinfo;
+
+namespace inet::tcp
+{
+	// Caches name lookups for connections made from a single thread (it is not thread-safe, use one per thread or shard)
+	class dnscache
+	{
+	public:
+
+		dnscache(std::chrono::seconds ttl = std::chrono::seconds(60), size_t capacity = 1024);
+
+		dnscache(const dnscache& rhs) = delete;
+
+		~dnscache();
+
+		// Returns the cached result or resolves it (error is a getaddrinfo error code), the list stays valid until
+		// the next call to resolve or clear
+		const addrinfo * resolve(std::string_view node, std::string_view service, int& error);
+
+		// Forgets the lookup, so the next resolve asks again (when none of its addresses could be reached)
+		void invalidate(std::string_view node, std::string_view service);
+
+		void clear();
+
+		uint64_t hits() const noexcept;
+
+		uint64_t misses() const noexcept;
+
+	private:
+
+		struct entry
+		{
+			addrinfo *info;
+
+			std::chrono::steady_clock::time_point expires;
+		};
+
+		std::map<std::string, entry> _entries;
+
+		std::chrono::seconds _ttl;
+
+		size_t _capacity;
+
+		uint64_t _hits = 0;
+
+		uint64_t _misses = 0;
+	};
+}
\ No newline at end of file
@@ -15,26 +15,44 @@
 #include <arpa/inet.h>
 #include <poll.h>
 #include <unistd.h>
+#ifndef __linux__
+#include <netinet/tcp.h>
+#endif
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/tcp.h>
+#ifndef IP_LOCAL_PORT_RANGE
+#define IP_LOCAL_PORT_RANGE 51
+#endif
+#endif
 #endif
 
 #include <cassert>
 #include <algorithm>
+#include <mutex>
+
+// A peer that went away shows up as an error instead of SIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 using namespace inet::tcp;
 
 /*
- * Static functions that are used to intialize winsock
+ * Functions that are used to intialize winsock
 */
 #ifdef WINDOWS
+static std::mutex winsock_mutex;
 static int winsock_stack = 0;
 static WSADATA wsadata;
 
 #ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
-static void init_winsock()
+void inet::tcp::init_winsock()
 #else
-static bool init_winsock()
+bool inet::tcp::init_winsock()
 #endif
 {
+	std::lock_guard<std::mutex> lock(winsock_mutex);
 	if (winsock_stack == 0) {
 		auto ret = WSAStartup(MAKEWORD(2, 2), &wsadata);
 		if (ret < 0) {
@@ -51,8 +69,9 @@ static bool init_winsock()
 #endif
 }
 
-static void close_winsock()
+void inet::tcp::close_winsock()
 {
+	std::lock_guard<std::mutex> lock(winsock_mutex);
 	if (winsock_stack == 1) {
 		WSACleanup();
 	}
@@ -62,6 +81,30 @@ static void close_winsock()
 }
 #endif
 
+/*
+ * Whether the last socket call failed because a non-blocking socket wasn't ready
+ */
+static bool wouldblock()
+{
+#ifndef WINDOWS
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#else
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#endif
+}
+
+/*
+ * Whether the last connect or bind failed because the local address has no free ports left
+ */
+static bool portexhausted()
+{
+#ifndef WINDOWS
+	return errno == EADDRNOTAVAIL || errno == EADDRINUSE;
+#else
+	return WSAGetLastError() == WSAEADDRNOTAVAIL || WSAGetLastError() == WSAEADDRINUSE;
+#endif
+}
+
 /*
  * Exception class
  */
@@ -142,6 +185,97 @@ void exception::winerror()
 #endif
 #endif
 
+/*
+ * Source address pool
+ */
+sourcepool::sourcepool()
+{
+}
+
+bool sourcepool::add(std::string_view str)
+{
+	address addr = {};
+	std::string tmp(str);
+	if (inet_pton(AF_INET, tmp.c_str(), addr.bytes) == 1)
+		addr.family = AF_INET;
+	else if (inet_pton(AF_INET6, tmp.c_str(), addr.bytes) == 1)
+		addr.family = AF_INET6;
+	else
+		return false;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_addresses.push_back(addr);
+	return true;
+}
+
+void sourcepool::portrange(uint16_t low, uint16_t high)
+{
+	_portrange = static_cast<uint32_t>(low) | (static_cast<uint32_t>(high) << 16);
+}
+
+size_t sourcepool::size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _addresses.size();
+}
+
+uint64_t sourcepool::connects() const noexcept
+{
+	return _connects;
+}
+
+uint64_t sourcepool::exhausted() const noexcept
+{
+	return _exhausted;
+}
+
+size_t sourcepool::count(int family) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return std::count_if(_addresses.begin(), _addresses.end(), [family](const address& a) { return a.family == family; });
+}
+
+bool sourcepool::bind(socket_t s, int family)
+{
+	// Pick the next address of the right family
+	address addr;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		size_t n = _addresses.size(), i;
+		auto start = _next++;
+		for (i = 0; i < n; ++i) {
+			if (_addresses[(start+i) % n].family == family)
+				break;
+		}
+		if (i == n)
+			return true;
+		addr = _addresses[(start+i) % n];
+	}
+
+#ifdef __linux__
+	// Delay picking the port until connect, so the same port can be reused towards different destinations
+	int one = 1;
+	setsockopt(s, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+
+	// Only supported since linux 6.3, older kernels simply use the system wide range
+	if (_portrange != 0)
+		setsockopt(s, IPPROTO_IP, IP_LOCAL_PORT_RANGE, &_portrange, sizeof(_portrange));
+#endif
+
+	if (family == AF_INET) {
+		sockaddr_in sa = {};
+		sa.sin_family = AF_INET;
+		std::copy(addr.bytes, addr.bytes+4, reinterpret_cast<uint8_t*>(&sa.sin_addr));
+		return ::bind(s, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0;
+	}
+	else {
+		sockaddr_in6 sa = {};
+		sa.sin6_family = AF_INET6;
+		std::copy(addr.bytes, addr.bytes+16, reinterpret_cast<uint8_t*>(&sa.sin6_addr));
+		return ::bind(s, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0;
+	}
+}
+
 /*
  * Streambuf class
  */
@@ -188,6 +322,26 @@ bool streambuf::checksocket(socket_t s)
 	return true;
 }
 
+bool streambuf::checkwritable(socket_t s)
+{
+	// Wait until the send buffer of a non-blocking socket has room again
+	pollfd pfd = {s, POLLOUT, 0};
+	int timeleft = std::max(_duration - std::chrono::duration_cast<milisecond>(std::chrono::high_resolution_clock::now()-_wbegin).count(), 0);
+#ifndef WINDOWS
+	auto ret = poll(&pfd, 1, _duration > 0 ? timeleft : -1);
+#else
+	auto ret = WSAPoll(&pfd, 1, _duration > 0 ? timeleft : -1);
+#endif
+	if (ret < 0) {
+#ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
+		throw exception();
+#else
+		return false;
+#endif
+	}
+	return ret > 0;
+}
+
 void streambuf::readfunc(const void * const t, size_t& res, char *begin, size_t len)
 {
 	// Check for time out and size limit
@@ -195,8 +349,13 @@ void streambuf::readfunc(const void * const t, size_t& res, char *begin, size_t
 	if (!checksocket(socket))
 		return;
 
-	// Read data
+	// Read data (accepted sockets are non-blocking, so wait again if the data was already gone)
     auto ret = recv(socket, begin, len, 0);
+	while (ret < 0 && wouldblock()) {
+		if (!checksocket(socket))
+			return;
+		ret = recv(socket, begin, len, 0);
+	}
 	if (ret < 0) {
 #ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
 		throw exception();
@@ -214,7 +373,14 @@ void streambuf::readfunc(const void * const t, size_t& res, char *begin, size_t
 void streambuf::writefunc(const void * const t, size_t& res, char *begin, size_t len)
 {
 	assert(len <= INT32_MAX);
-    auto ret = send(*static_cast<const socket_t * const>(t), begin, len, 0);
+	auto socket = *static_cast<const socket_t * const>(t);
+	_wbegin = std::chrono::high_resolution_clock::now();
+    auto ret = send(socket, begin, len, MSG_NOSIGNAL);
+	while (ret < 0 && wouldblock()) {
+		if (!checkwritable(socket))
+			return;
+		ret = send(socket, begin, len, MSG_NOSIGNAL);
+	}
     if (ret < 0) {
 #ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
         throw exception();
@@ -225,6 +391,121 @@ void streambuf::writefunc(const void * const t, size_t& res, char *begin, size_t
     res += ret;
 }
 
+bool streambuf::enable_zerocopy(socket_t s, size_t threshold)
+{
+#if !defined WINDOWS && defined SO_ZEROCOPY
+	int one = 1;
+	if (setsockopt(s, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+		return false;
+	_zerocopy = true;
+	_zcthreshold = threshold;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void streambuf::disable_zerocopy()
+{
+	_zerocopy = false;
+}
+
+void streambuf::reset_zerocopy()
+{
+	_zerocopy = false;
+	_zcsent = _zcdone = 0;
+}
+
+uint32_t streambuf::writezerocopy(socket_t s, const char *data, size_t len)
+{
+	// Everything that was written before has to go out first
+	if (this->pubsync() == -1)
+		return 0;
+
+	bool zerocopy = _zerocopy && len >= _zcthreshold;
+	uint32_t ticket = 0;
+	size_t out = 0;
+	while (out < len) {
+		_wbegin = std::chrono::high_resolution_clock::now();
+#if !defined WINDOWS && defined MSG_ZEROCOPY
+		auto ret = send(s, data+out, len-out, MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+		if (ret < 0) {
+			// Out of locked memory, the kernel won't pin any more pages so copy the rest
+			if (zerocopy && errno == ENOBUFS) {
+				zerocopy = false;
+				continue;
+			}
+#else
+		auto ret = send(s, data+out, len-out, MSG_NOSIGNAL);
+		if (ret < 0) {
+#endif
+			if (wouldblock() && checkwritable(s))
+				continue;
+#ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
+			throw exception();
+#else
+			return ticket;
+#endif
+		}
+		out += ret;
+
+		// The kernel numbers every successful zero-copy send, starting at zero
+		if (zerocopy)
+			ticket = ++_zcsent;
+	}
+	return ticket;
+}
+
+bool streambuf::reapzerocopy(socket_t s, int timeout)
+{
+#if !defined WINDOWS && defined SO_EE_ORIGIN_ZEROCOPY
+	// The error queue signals POLLERR when notifications are available, a hang up without any means the sends
+	// will never complete
+	pollfd pfd = {s, 0, 0};
+	if (timeout != 0) {
+		auto ret = poll(&pfd, 1, timeout);
+		if (ret < 0)
+			return false;
+		if (ret == 0)
+			return true;
+	}
+
+	while (true) {
+		char control[128];
+		msghdr msg = {};
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(s, &msg, MSG_ERRQUEUE) < 0)
+			return (pfd.revents & (POLLHUP | POLLNVAL)) == 0;
+
+		for (auto cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+				!(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			// A notification covers the sends [ee_info, ee_data] and TCP completes them in order
+			auto err = reinterpret_cast<sock_extended_err*>(CMSG_DATA(cm));
+			if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			if (static_cast<int32_t>(err->ee_data+1 - _zcdone) > 0)
+				_zcdone = err->ee_data+1;
+		}
+	}
+#else
+	return false;
+#endif
+}
+
+bool streambuf::zerocopy_enabled() const noexcept
+{
+	return _zerocopy;
+}
+
+bool streambuf::zerocopy_done(uint32_t ticket) const noexcept
+{
+	return static_cast<int32_t>(_zcdone - ticket) >= 0;
+}
+
 /*
  * Client class
  */
@@ -272,6 +553,90 @@ const char * client::getprotocol()
 		return "Not connected";
 }
 
+void client::setdnscache(dnscache *cache) noexcept
+{
+	_dns = cache;
+}
+
+void client::setsourcepool(sourcepool *pool) noexcept
+{
+	_pool = pool;
+}
+
+bool client::getinfo(info& i) const
+{
+	if (!_connected)
+		return false;
+
+#if !defined WINDOWS && defined TCP_INFO
+	// Older kernels return a shorter structure, the missing fields stay zero
+	tcp_info ti = {};
+	socklen_t len = sizeof(ti);
+	if (getsockopt(_socket, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0)
+		return false;
+
+	i.rtt = ti.tcpi_rtt;
+	i.rttvar = ti.tcpi_rttvar;
+	i.cwnd = ti.tcpi_snd_cwnd;
+	i.retransmits = ti.tcpi_total_retrans;
+	i.unacked = ti.tcpi_unacked;
+	i.delivery_rate = ti.tcpi_delivery_rate;
+	i.busy_time = ti.tcpi_busy_time;
+	i.rwnd_limited = ti.tcpi_rwnd_limited;
+	i.sndbuf_limited = ti.tcpi_sndbuf_limited;
+	i.taken = std::chrono::steady_clock::now();
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool client::enable_zerocopy(size_t threshold)
+{
+	if (!_connected)
+		return false;
+	return static_cast<streambuf*>(_sb)->enable_zerocopy(_socket, threshold);
+}
+
+void client::disable_zerocopy()
+{
+	if (_sb)
+		static_cast<streambuf*>(_sb)->disable_zerocopy();
+}
+
+uint32_t client::write_zerocopy(const char *data, size_t size)
+{
+	assert(_connected);
+	auto sb = static_cast<streambuf*>(_sb);
+	if (!sb->zerocopy_enabled()) {
+		this->write(data, size);
+		this->flush();
+		return 0;
+	}
+	return sb->writezerocopy(_socket, data, size);
+}
+
+bool client::zerocopy_reusable(uint32_t ticket)
+{
+	if (!_connected || _sb == nullptr)
+		return true;
+	auto sb = static_cast<streambuf*>(_sb);
+	if (!sb->zerocopy_done(ticket))
+		sb->reapzerocopy(_socket, 0);
+	return sb->zerocopy_done(ticket);
+}
+
+void client::zerocopy_wait(uint32_t ticket)
+{
+	if (!_connected || _sb == nullptr)
+		return;
+	auto sb = static_cast<streambuf*>(_sb);
+	while (_connected && !sb->zerocopy_done(ticket)) {
+		if (!sb->reapzerocopy(_socket, -1))
+			break;
+	}
+}
+
 void client::_createsb()
 {
     // The base class deletes this value
@@ -282,6 +647,7 @@ void client::_createsb()
 
 void client::_resetsb()
 {
+    static_cast<streambuf*>(_sb)->reset_zerocopy();
     if (_connected == false) {
         _sb->reset(_socket);
         this->clear();
@@ -294,20 +660,25 @@ void client::_resetsb()
 
 void client::_connect(std::string_view node, std::string_view service)
 {
-    static bool sb_init = false;
-    addrinfo hints = {}, *info, *p;
+    addrinfo hints = {}, *info = nullptr;
+    const addrinfo *p, *list;
 
-    // Initialize the stream buffer if that hasn't been done
-    if (sb_init == false) {
+    // Every client owns its stream buffer, it's created on the first connect
+    if (_sb == nullptr)
         _createsb();
-        sb_init = true;
-    }
 
     // Find an appropriate socket
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    int ret = getaddrinfo(std::string(node).c_str(), std::string(service).c_str(), &hints, &info);
-    if (ret < 0) {
+    int ret;
+    if (_dns) {
+        list = _dns->resolve(node, service, ret);
+    }
+    else {
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        ret = getaddrinfo(std::string(node).c_str(), std::string(service).c_str(), &hints, &info);
+        list = info;
+    }
+    if (ret != 0) {
 #ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
         throw exception(ret);
 #else
@@ -317,41 +688,138 @@ void client::_connect(std::string_view node, std::string_view service)
     }
 
     // Loop through possible settings and select the first one that works
-    for (p = info; p != nullptr; p = p->ai_next) {
-        _socket = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (_socket == -1) continue;
-
-        ret = connect(_socket, p->ai_addr, p->ai_addrlen);
-		if (ret < 0) {
+    for (p = list; p != nullptr; p = p->ai_next) {
+        // When a source address runs out of ports, try the other addresses in the pool before moving on
+        size_t attempts = _pool ? std::max<size_t>(_pool->count(p->ai_family), 1) : 1;
+        for (size_t i = 0; i < attempts; ++i) {
+            _socket = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+            if (_socket == -1) break;
+
+            if (_pool == nullptr || _pool->bind(_socket, p->ai_family))
+                ret = connect(_socket, p->ai_addr, p->ai_addrlen);
+            else
+                ret = -1;
+            if (ret == 0)
+                break;
+
+            bool exhausted = portexhausted();
 #ifndef WINDOWS
 			::close(_socket);
 #else
 			::closesocket(_socket);
 #endif
-		}
-        else 
+            if (!exhausted || _pool == nullptr)
+                break;
+            ++_pool->_exhausted;
+        }
+        if (_socket != -1 && ret == 0)
             break;
     }
 
-    // Cleanup
-    freeaddrinfo(info);
+    // Cleanup (cached lookups belong to the cache)
+    if (info)
+        freeaddrinfo(info);
     if (p != nullptr) {
+        if (_pool)
+            ++_pool->_connects;
+        if (_nodelay) {
+            int one = 1;
+            setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+        }
         _resetsb();
         _connected = true; // MUST COME AFTER _resetsb
     }
     else {
+        // The cached addresses may be stale, the next connect resolves the name again
+        if (_dns)
+            _dns->invalidate(node, service);
         this->setstate(std::ios_base::badbit);
     }
 }
 
+void client::_attach(socket_t s)
+{
+    _disconnect();
+    if (_sb == nullptr)
+        _createsb();
+    _socket = s;
+    _resetsb();
+    _connected = true; // MUST COME AFTER _resetsb
+}
+
+bool client::is_stale()
+{
+	if (!_connected)
+		return true;
+
+	// Readable means data, the end of the stream or an error, none of which should happen while idle
+	pollfd pfd = {_socket, POLLIN, 0};
+#ifndef WINDOWS
+	return poll(&pfd, 1, 0) != 0;
+#else
+	return WSAPoll(&pfd, 1, 0) != 0;
+#endif
+}
+
+void client::set_nodelay(bool nodelay)
+{
+	_nodelay = nodelay;
+	if (_connected) {
+		int value = nodelay ? 1 : 0;
+		setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+}
+
+void client::set_teardown(teardown_e policy, unsigned int deadline) noexcept
+{
+	_teardown = policy;
+	_teardowndeadline = deadline;
+}
+
+std::chrono::microseconds client::teardown_time() const noexcept
+{
+	return _teardowntime;
+}
+
 void client::_disconnect()
 {
     if (_connected) {
+        auto begin = std::chrono::steady_clock::now();
+        if (_teardown == teardown_e::ABORTIVE) {
+            // Closing with a zero linger time sends a reset and skips TIME_WAIT
+            linger l = {1, 0};
+            setsockopt(_socket, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&l), sizeof(l));
+        }
+        else if (_teardown == teardown_e::HALFCLOSE) {
+            // Let the peer see the end of the stream, then discard whatever it still sends until it closes as well
+#ifndef WINDOWS
+            ::shutdown(_socket, SHUT_WR);
+#else
+            ::shutdown(_socket, SD_SEND);
+#endif
+            auto deadline = begin+std::chrono::milliseconds(_teardowndeadline);
+            char buffer[4096];
+            while (true) {
+                auto timeleft = std::chrono::duration_cast<std::chrono::milliseconds>(deadline-std::chrono::steady_clock::now()).count();
+                pollfd pfd = {_socket, POLLIN, 0};
+#ifndef WINDOWS
+                if (timeleft <= 0 || poll(&pfd, 1, static_cast<int>(timeleft)) <= 0)
+                    break;
+#else
+                if (timeleft <= 0 || WSAPoll(&pfd, 1, static_cast<int>(timeleft)) <= 0)
+                    break;
+#endif
+                auto ret = recv(_socket, buffer, sizeof(buffer), 0);
+                if (ret == 0 || (ret < 0 && !wouldblock()))
+                    break;
+            }
+        }
 #ifndef WINDOWS
 		::close(_socket);
 #else
 		::closesocket(_socket);
 #endif
+        _teardowntime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-begin);
         _resetsb();
         _connected = false; // MUST COME AFTER _resetsb
     }
@@ -1,7 +1,12 @@
 #pragma once
 
 #include <exception>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include "../gconnection.hpp"
+#include "dnscache.hpp"
 
 // If for some inane reason you don't want to use exception handling or want to use standard library exceptions
 //#define INET_TCP_DISABLE_CUSTOM_EXCEPTION
@@ -42,6 +47,44 @@ namespace inet::tcp
     };
 #endif
 
+#ifdef WINDOWS
+	// Reference counted winsock initialization, shared by every class that owns sockets
+#ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
+	void init_winsock();
+#else
+	bool init_winsock();
+#endif
+
+	void close_winsock();
+#endif
+
+	// Snapshot of the kernel's view of a connection (linux only), times are in microseconds
+	struct info
+	{
+		// Smoothed round trip time and its variance
+		uint32_t rtt = 0;
+		uint32_t rttvar = 0;
+
+		// Congestion window in segments
+		uint32_t cwnd = 0;
+
+		// Retransmitted segments over the lifetime of the connection
+		uint32_t retransmits = 0;
+
+		// Segments that have been sent but not yet acknowledged
+		uint32_t unacked = 0;
+
+		// Most recent goodput estimate in bytes per second
+		uint64_t delivery_rate = 0;
+
+		// Time spent sending data, and the part of it limited by the receive window or the send buffer
+		uint64_t busy_time = 0;
+		uint64_t rwnd_limited = 0;
+		uint64_t sndbuf_limited = 0;
+
+		std::chrono::steady_clock::time_point taken;
+	};
+
     class streambuf : public gstreambuf<char>
     {
     public:
@@ -52,19 +95,117 @@ namespace inet::tcp
 
         ~streambuf();
 
+		// Zero-copy sending (linux only), data smaller than the threshold is always copied
+		bool enable_zerocopy(socket_t s, size_t threshold);
+
+		void disable_zerocopy();
+
+		void reset_zerocopy();
+
+		// Sends the data without copying it when possible, returns the ticket of the last zero-copy send (0 if everything was copied)
+		uint32_t writezerocopy(socket_t s, const char *data, size_t len);
+
+		// Reads completion notifications from the socket error queue, waits at most timeout ms (-1 is infinite).
+		// Returns false once the connection is gone and no more notifications can come.
+		bool reapzerocopy(socket_t s, int timeout);
+
+		bool zerocopy_enabled() const noexcept;
+
+		// Whether every zero-copy send up to and including the ticket has completed
+		bool zerocopy_done(uint32_t ticket) const noexcept;
+
     protected:
 
 		using typename gstreambuf<char>::milisecond;
 
 		bool checksocket(socket_t s);
 
+		// Waits until the socket can be written, the timeout counts from the last write that made progress
+		bool checkwritable(socket_t s);
+
         void readfunc(const void * const t, size_t& res, char *begin, size_t len) override;
 
         void writefunc(const void * const t, size_t& res, char *begin, size_t len) override;
+
+		bool _zerocopy = false;
+
+		size_t _zcthreshold = 0;
+
+		uint32_t _zcsent = 0;
+
+		uint32_t _zcdone = 0;
+
+		// Start of the current write, reads move the read deadline (_begin) but not this one
+		std::chrono::high_resolution_clock::time_point _wbegin;
     };
 
+    class client;
+
+    class listener;
+
+	// Local addresses that outgoing connections are spread over round robin, so every address gets its own set of
+	// ephemeral ports per destination. Share one pool between many clients, it has to outlive all of them.
+	class sourcepool
+	{
+		friend client;
+
+	public:
+
+		sourcepool();
+
+		sourcepool(const sourcepool& rhs) = delete;
+
+		// Adds a numeric IPv4 or IPv6 local address, returns false if it can't be parsed
+		bool add(std::string_view address);
+
+		// Hints the kernel to pick ports in [low, high] (IP_LOCAL_PORT_RANGE), zero for both uses the system range
+		void portrange(uint16_t low, uint16_t high);
+
+		size_t size() const;
+
+		// Connects that succeeded through the pool
+		uint64_t connects() const noexcept;
+
+		// Connect attempts that failed because the local address ran out of ports
+		uint64_t exhausted() const noexcept;
+
+	private:
+
+		struct address
+		{
+			int family;
+
+			uint8_t bytes[16];
+		};
+
+		size_t count(int family) const;
+
+		// Binds the socket to the next local address of the family without reserving a port, returns false on failure
+		// (sockets of a family without any address in the pool are left alone)
+		bool bind(socket_t s, int family);
+
+		mutable std::mutex _mutex;
+
+		std::vector<address> _addresses;
+
+		uint32_t _portrange = 0;
+
+		std::atomic<uint64_t> _next = 0;
+
+		std::atomic<uint64_t> _connects = 0;
+
+		std::atomic<uint64_t> _exhausted = 0;
+	};
+
+	// How close tears down a connection. DEFAULT closes the socket (TLS first exchanges close_notify with the peer),
+	// UNIDIRECTIONAL doesn't wait for the peer's close_notify, ABORTIVE resets the connection (SO_LINGER 0) and
+	// HALFCLOSE shuts down the sending side and waits up to a deadline for the peer to finish before closing.
+	enum class teardown_e { DEFAULT, UNIDIRECTIONAL, ABORTIVE, HALFCLOSE };
+
     class client : public gconnection<char>
     {
+		friend listener;
+
     public:
 
 		client();
@@ -79,6 +220,41 @@ namespace inet::tcp
 
 		virtual const char * getprotocol() override;
 
+		// Binds outgoing connections to addresses from the pool, nullptr lets the kernel choose
+		void setsourcepool(sourcepool *pool) noexcept;
+
+		// Resolves names through the cache instead of calling getaddrinfo on every connect, nullptr disables it
+		void setdnscache(dnscache *cache) noexcept;
+
+		// Takes a TCP_INFO snapshot of the connection, returns false if not connected or not supported
+		bool getinfo(info& i) const;
+
+		// Enables zero-copy sends for writes of at least threshold bytes, returns false if the socket doesn't support it
+		virtual bool enable_zerocopy(size_t threshold = 64*1024);
+
+		void disable_zerocopy();
+
+		// Flushes the stream and sends the data, the buffer may not be modified or freed until the ticket is reusable
+		uint32_t write_zerocopy(const char *data, size_t size);
+
+		// Checks (without blocking) whether the buffer that belongs to the ticket may be reused
+		bool zerocopy_reusable(uint32_t ticket);
+
+		// Blocks until the buffer that belongs to the ticket may be reused, or the connection is gone
+		void zerocopy_wait(uint32_t ticket);
+
+		// Checks without blocking whether the peer closed an idle connection or sent something nobody asked for
+		virtual bool is_stale();
+
+		// Disables Nagle's algorithm, the stream already gathers writes until a flush
+		void set_nodelay(bool nodelay);
+
+		// Changes how the connection is closed, deadline (ms) only applies to HALFCLOSE
+		void set_teardown(teardown_e policy, unsigned int deadline = 1000) noexcept;
+
+		// How long the last close took
+		std::chrono::microseconds teardown_time() const noexcept;
+
     protected:
 
         virtual void _createsb();
@@ -89,6 +265,21 @@ namespace inet::tcp
 
         void _disconnect();
 
+		// Takes ownership of an already connected socket (used for accepted connections)
+		void _attach(socket_t s);
+
 		socket_t _socket;
+
+		sourcepool *_pool = nullptr;
+
+		dnscache *_dns = nullptr;
+
+		bool _nodelay = false;
+
+		teardown_e _teardown = teardown_e::DEFAULT;
+
+		unsigned int _teardowndeadline = 1000;
+
+		std::chrono::microseconds _teardowntime = std::chrono::microseconds(0);
     };
 }
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "tcpserver.hpp"
+
+#if (defined _WIN32 || defined WIN32)
+#define WINDOWS
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#undef max
+#else
+#include <cstring>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+using namespace inet::tcp;
+
+static void close_socket(socket_t s)
+{
+#ifndef WINDOWS
+	::close(s);
+#else
+	::closesocket(s);
+#endif
+}
+
+/*
+ * Listener class
+ */
+listener::listener()
+{
+#ifdef WINDOWS
+	// Same as tcp::client, without custom exceptions a failure shows up when open() can't resolve
+	init_winsock();
+#endif
+}
+
+listener::~listener()
+{
+	close();
+#ifdef WINDOWS
+	close_winsock();
+#endif
+}
+
+bool listener::is_open() const noexcept
+{
+	return _open;
+}
+
+void listener::open(std::string_view node, std::string_view service, int backlog, int deferaccept)
+{
+	addrinfo hints = {}, *info, *p;
+
+	close();
+
+	// Find an appropriate address to bind to (an empty node binds to every interface)
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	int ret = getaddrinfo(node.empty() ? nullptr : std::string(node).c_str(), std::string(service).c_str(), &hints, &info);
+	if (ret != 0) {
+#ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
+		throw exception(ret);
+#else
+		return;
+#endif
+	}
+
+	for (p = info; p != nullptr; p = p->ai_next) {
+#ifndef WINDOWS
+		_socket = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol);
+#else
+		_socket = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+#endif
+		if (_socket == static_cast<socket_t>(-1)) continue;
+
+		// Every worker binds its own socket to the same address, the kernel spreads the connections over them
+		int one = 1;
+		setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+#ifdef SO_REUSEPORT
+		if (setsockopt(_socket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+			close_socket(_socket);
+			continue;
+		}
+#endif
+
+		if (bind(_socket, p->ai_addr, p->ai_addrlen) < 0 || listen(_socket, backlog) < 0) {
+			close_socket(_socket);
+			continue;
+		}
+
+		// Only wake up accept once the client has actually sent data
+#ifdef TCP_DEFER_ACCEPT
+		if (deferaccept > 0)
+			setsockopt(_socket, IPPROTO_TCP, TCP_DEFER_ACCEPT, &deferaccept, sizeof(deferaccept));
+#endif
+		break;
+	}
+
+	freeaddrinfo(info);
+	if (p == nullptr) {
+#ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
+		throw exception();
+#else
+		return;
+#endif
+	}
+	_open = true;
+}
+
+void listener::close()
+{
+	if (_open) {
+		close_socket(_socket);
+		_open = false;
+	}
+}
+
+void listener::shutdown()
+{
+	// Wakes up a thread that is waiting in accept
+	if (_open) {
+#ifndef WINDOWS
+		::shutdown(_socket, SHUT_RDWR);
+#else
+		::shutdown(_socket, SD_BOTH);
+#endif
+	}
+}
+
+bool listener::accept(client& c, int timeout)
+{
+	if (!_open)
+		return false;
+
+	while (true) {
+#ifndef WINDOWS
+		auto s = accept4(_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (s >= 0) {
+#else
+		auto s = ::accept(_socket, nullptr, nullptr);
+		if (s != INVALID_SOCKET) {
+			u_long one = 1;
+			ioctlsocket(s, FIONBIO, &one);
+#endif
+			c._attach(s);
+			return true;
+		}
+
+#ifndef WINDOWS
+		// The peer gave up before we got to it, just try the next one
+		if (errno == ECONNABORTED || errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+#else
+		if (WSAGetLastError() != WSAEWOULDBLOCK) {
+#endif
+#ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
+			throw exception();
+#else
+			return false;
+#endif
+		}
+
+		// Wait for the next connection
+		pollfd pfd = {_socket, POLLIN, 0};
+#ifndef WINDOWS
+		auto ret = poll(&pfd, 1, timeout);
+#else
+		auto ret = WSAPoll(&pfd, 1, timeout);
+#endif
+		if (ret <= 0 || (pfd.revents & POLLIN) == 0)
+			return false;
+	}
+}
+
+/*
+ * Server class
+ */
+server::server()
+{
+}
+
+server::~server()
+{
+	stop();
+}
+
+bool server::is_running() const noexcept
+{
+	return _running;
+}
+
+void server::start(std::string_view node, std::string_view service, unsigned int workers, handler_t handler, int backlog, int deferaccept)
+{
+	stop();
+	_handler = std::move(handler);
+
+	// Open every listener before starting any threads, so a bind failure leaves nothing running (without custom
+	// exceptions open only leaves the listener closed)
+	try {
+		for (unsigned int i = 0; i < std::max(workers, 1U); ++i) {
+			_listeners.push_back(new listener);
+			_listeners.back()->open(node, service, backlog, deferaccept);
+			if (!_listeners.back()->is_open())
+				break;
+		}
+	}
+	catch (...) {
+		for (auto l : _listeners)
+			delete l;
+		_listeners.clear();
+		throw;
+	}
+	if (!_listeners.back()->is_open()) {
+		for (auto l : _listeners)
+			delete l;
+		_listeners.clear();
+		return;
+	}
+
+	_running = true;
+	for (auto l : _listeners)
+		_workers.emplace_back(&server::_work, this, l);
+}
+
+void server::stop()
+{
+	_running = false;
+	for (auto l : _listeners)
+		l->shutdown();
+	for (auto& t : _workers)
+		t.join();
+	for (auto l : _listeners)
+		delete l;
+	_workers.clear();
+	_listeners.clear();
+}
+
+uint64_t server::accepted() const noexcept
+{
+	return _accepted;
+}
+
+void server::_work(listener *l)
+{
+	// The client (and its buffers) are reused for every connection this worker accepts
+	client c;
+	while (_running && l->is_open()) {
+		try {
+			if (!l->accept(c))
+				continue;
+			++_accepted;
+			_handler(c);
+		}
+		catch (...) {
+			// A failing connection or handler shouldn't take the worker down with it
+		}
+		c.close();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "tcpclient.hpp"
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace inet::tcp
+{
+	// A single listening socket, every worker thread should own one so accepting doesn't need a shared lock
+    class listener
+    {
+    public:
+
+        listener();
+
+        listener(const listener& rhs) = delete;
+
+        ~listener();
+
+        bool is_open() const noexcept;
+
+        // Binds with SO_REUSEPORT so multiple listeners can share the address, deferaccept is in seconds (0 disables it)
+        void open(std::string_view node, std::string_view service, int backlog = 1024, int deferaccept = 0);
+
+        void close();
+
+        // Stops pending and future accept calls without closing the socket
+        void shutdown();
+
+        // Accepts a connection into the client, the socket is non-blocking. Waits at most timeout ms (-1 is infinite)
+        // and returns false if nothing was accepted. Only plain tcp clients can be used.
+        bool accept(client& c, int timeout = -1);
+
+    private:
+
+        bool _open = false;
+
+        socket_t _socket;
+    };
+
+    // Accepts connections on multiple threads, each with its own listener
+    class server
+    {
+    public:
+
+        typedef std::function<void(client&)> handler_t;
+
+        server();
+
+        server(const server& rhs) = delete;
+
+        ~server();
+
+        bool is_running() const noexcept;
+
+        // Starts the worker threads, the handler is called on the worker thread for every accepted connection
+        // and the connection is closed once it returns. If a listener can't be opened nothing is started (check
+        // is_running when custom exceptions are disabled).
+        void start(std::string_view node, std::string_view service, unsigned int workers, handler_t handler, int backlog = 1024, int deferaccept = 0);
+
+        void stop();
+
+        // Total number of accepted connections
+        uint64_t accepted() const noexcept;
+
+    private:
+
+        void _work(listener *l);
+
+        std::vector<listener*> _listeners;
+
+        std::vector<std::thread> _workers;
+
+        handler_t _handler;
+
+        std::atomic<bool> _running = false;
+
+        std::atomic<uint64_t> _accepted = 0;
+    };
+}
\ No newline at end of file
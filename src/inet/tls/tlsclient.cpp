@@ -2,58 +2,266 @@
 #include "wincert.hpp"
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <openssl/pem.h>
+#include <mutex>
+#include <cassert>
+#include <algorithm>
+
+#if (defined _WIN32 || defined WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 using namespace inet::tls;
 
 /*
- * Functions that are used to intialize OpenSSL and managing an OpenSSL context
+ * Session cache class
  */
-static int openssl_stack = 0;
+sessioncache::sessioncache(size_t capacity, std::chrono::seconds lifetime)
+	: _capacity(capacity), _lifetime(lifetime)
+{
+}
 
-static SSL_CTX *ctx = nullptr;
+sessioncache::~sessioncache()
+{
+	clear();
+}
 
-#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
-static void init_openssl()
+SSL_SESSION * sessioncache::get(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it = _entries.find(key);
+	if (it == _entries.end()) {
+		++_misses;
+		return nullptr;
+	}
+
+	// Expired, or not resumable anymore according to OpenSSL
+	auto session = it->second.session;
+	if (it->second.expires <= std::chrono::steady_clock::now() || !SSL_SESSION_is_resumable(session)) {
+		_erase(it);
+		++_misses;
+		return nullptr;
+	}
+
+	// TLS 1.3 tickets should only be used once, the server sends fresh ones on every connection
+	if (SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION) {
+		SSL_SESSION_up_ref(session);
+		_erase(it);
+	}
+	else {
+		SSL_SESSION_up_ref(session);
+		_lru.splice(_lru.begin(), _lru, it->second.lru);
+	}
+	++_offered;
+	return session;
+}
+
+void sessioncache::put(const std::string& key, SSL_SESSION *session)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it = _entries.find(key);
+	if (it != _entries.end())
+		_erase(it);
+
+	// Make room by dropping the least recently used session
+	while (!_lru.empty() && _entries.size() >= _capacity)
+		_erase(_entries.find(_lru.back()));
+
+	_lru.push_front(key);
+	_entries[key] = { session, std::chrono::steady_clock::now() + _lifetime, _lru.begin() };
+}
+
+void sessioncache::remove(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it = _entries.find(key);
+	if (it != _entries.end())
+		_erase(it);
+}
+
+void sessioncache::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (auto& pair : _entries)
+		SSL_SESSION_free(pair.second.session);
+	_entries.clear();
+	_lru.clear();
+}
+
+size_t sessioncache::size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries.size();
+}
+
+uint64_t sessioncache::offered() const noexcept
+{
+	return _offered;
+}
+
+uint64_t sessioncache::resumed() const noexcept
+{
+	return _resumed;
+}
+
+uint64_t sessioncache::misses() const noexcept
+{
+	return _misses;
+}
+
+void sessioncache::_erase(std::map<std::string, entry>::iterator it)
+{
+	SSL_SESSION_free(it->second.session);
+	_lru.erase(it->second.lru);
+	_entries.erase(it);
+}
+
+/*
+ * Indices used to find the context and session key from inside OpenSSL callbacks
+ */
+static int context_index()
+{
+	static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+	return index;
+}
+
+static int sessionkey_index()
+{
+	static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+	return index;
+}
+
+static int new_session(SSL *ssl, SSL_SESSION *session)
+{
+	auto ctx = static_cast<context*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), context_index()));
+	auto key = static_cast<std::string*>(SSL_get_ex_data(ssl, sessionkey_index()));
+	if (ctx == nullptr || key == nullptr || ctx->sessions() == nullptr)
+		return 0;
+
+	// Returning 1 tells OpenSSL that the cache now owns the reference
+	ctx->sessions()->put(*key, session);
+	return 1;
+}
+
+/*
+ * Context class
+ */
+// Certificate validation, SNI and ALPN for a new client SSL structure
+static bool prepare(SSL *ssl, std::string_view node, const uint8_t *protocolList, unsigned int listSize)
+{
+	// Make sure the host doesn't contain any cheeky null characters and is not null
+	if (node.length() != std::string(node).length() && std::string(node).length() > 0)
+		return false;
+
+    // Enable certificate validation
+    SSL_set_hostflags(ssl, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
+	if (SSL_set1_host(ssl, std::string(node).c_str()) != 1)
+		return false;
+    SSL_set_verify(ssl, SSL_VERIFY_PEER, nullptr);
+
+	// Enables SNI (not required by the standard, but some servers throw a fit if you don't enable it)
+	if (SSL_set_tlsext_host_name(ssl, std::string(node).c_str()) != 1)
+		return false;
+
+	// Enables ALPN (required for http/2.0)
+	if (protocolList)
+		SSL_set_alpn_protos(ssl, protocolList, listSize);
+	return true;
+}
+
+// Offers the cached session for key, new sessions of this connection are stored under the same key
+static void offer(SSL *ssl, sessioncache *sessions, std::string& key)
+{
+	SSL_set_ex_data(ssl, sessionkey_index(), &key);
+	auto session = sessions->get(key);
+	if (session) {
+		SSL_set_session(ssl, session);
+		SSL_SESSION_free(session);
+	}
+}
+
+static void setblocking(inet::tcp::socket_t s, bool blocking)
+{
+#ifndef WINDOWS
+	auto flags = fcntl(s, F_GETFL, 0);
+	fcntl(s, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
 #else
-static bool init_openssl()
+	u_long mode = blocking ? 0 : 1;
+	ioctlsocket(s, FIONBIO, &mode);
 #endif
+}
+
+static const char * protocolname(SSL *ssl)
+{
+	auto session = SSL_get_session(ssl);
+	if (session == nullptr)
+		return "TLS";
+
+	auto id = SSL_SESSION_get_protocol_version(session);
+	if (id == TLS1_2_VERSION)
+		return "TLS 1.2";
+	else
+		return "TLS 1.3";
+}
+
+context::options::options()
+	: ciphers("DHE-RSA-AES256-GCM-SHA384:DHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES256-GCM-SHA384:ECDHE-RSA-AES128-GCM-SHA256"),
+	ciphersuites("TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256")
+{
+}
+
+context::context()
+	: _ctx(nullptr)
+{
+}
+
+context::~context()
+{
+	SSL_CTX_free(_ctx);
+}
+
+std::shared_ptr<context> context::create(const options& opt)
 {
-	auto error_handling = [](except_e except) {
+	std::shared_ptr<context> ret(new context);
+
+	auto error_handling = [](except_e except) -> std::shared_ptr<context> {
 #ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
 		throw exception(except);
 #else
-		return false;
+		return nullptr;
 #endif
 	};
 
-    static bool initialized = false;
+	static std::once_flag initialized;
+	std::call_once(initialized, []() { SSL_library_init(); });
 
-    if (!initialized) {
-        SSL_library_init();
-        initialized = true;
-    }
-    if (openssl_stack == 0) {
-        // Check OpenSSL PRNG
-		if (RAND_status() != 1)
-			return error_handling(except_e::PRNG);
-        
-        // Create OpenSSL context
-        ctx = SSL_CTX_new(TLS_client_method());
-
-        // Set the minimum TLS version
-        if (SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION) != 1)
-            return error_handling(except_e::TLS_VER);
-
-        // Only enable strong ciphers
-        const char *secure = "DHE-RSA-AES256-GCM-SHA384:DHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES256-GCM-SHA384:ECDHE-RSA-AES128-GCM-SHA256";
-		if (SSL_CTX_set_cipher_list(ctx, secure) != 1)
-			return error_handling(except_e::CIPHER);
-		
-		// Cipher suites for TLS 1.3
-		if (SSL_CTX_set_ciphersuites(ctx, "TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256") != 1)
-			return error_handling(except_e::CIPHER);
-
-		// Load trusted root certificates
+	// Check OpenSSL PRNG
+	if (RAND_status() != 1)
+		return error_handling(except_e::PRNG);
+
+	// Create OpenSSL context (owned by the object from here on)
+	auto ctx = ret->_ctx = SSL_CTX_new(TLS_client_method());
+	if (ctx == nullptr)
+		return error_handling(except_e::CONTEXT);
+
+	// Set the minimum TLS version
+	if (SSL_CTX_set_min_proto_version(ctx, opt.minversion) != 1)
+		return error_handling(except_e::TLS_VER);
+
+	// Only enable strong ciphers
+	if (SSL_CTX_set_cipher_list(ctx, opt.ciphers.c_str()) != 1)
+		return error_handling(except_e::CIPHER);
+
+	// Cipher suites for TLS 1.3
+	if (SSL_CTX_set_ciphersuites(ctx, opt.ciphersuites.c_str()) != 1)
+		return error_handling(except_e::CIPHER);
+
+	// Load trusted root certificates
+	if (opt.systemroots) {
 #ifndef WINDOWS
 		// On linux the OS root certificates are usually linked inside the default_verify_path
 		if (!SSL_CTX_set_default_verify_paths(ctx))
@@ -65,21 +273,89 @@ static bool init_openssl()
 			return error_handling(except_e::CERT_LOAD);
 		SSL_CTX_set_cert_store(ctx, store);
 #endif
-    }
-    ++openssl_stack;
-#ifdef INET_TLS_DISABLE_CUSTOM_EXCEPTION
-    return true;
+	}
+
+	// Additional certificates from disk
+	if (!opt.cafile.empty() || !opt.capath.empty()) {
+		if (SSL_CTX_load_verify_locations(ctx, opt.cafile.empty() ? nullptr : opt.cafile.c_str(), opt.capath.empty() ? nullptr : opt.capath.c_str()) != 1)
+			return error_handling(except_e::CERT_LOAD);
+	}
+
+	// Additional certificates from memory (one or more PEM blocks)
+	if (!opt.capem.empty()) {
+		auto bio = BIO_new_mem_buf(opt.capem.data(), static_cast<int>(opt.capem.size()));
+		if (bio == nullptr)
+			return error_handling(except_e::CERT_LOAD);
+		auto store = SSL_CTX_get_cert_store(ctx);
+		int count = 0;
+		X509 *cert;
+		while ((cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) != nullptr) {
+			X509_STORE_add_cert(store, cert);
+			X509_free(cert);
+			++count;
+		}
+		BIO_free(bio);
+		ERR_clear_error(); // Reading past the last certificate leaves an error behind
+		if (count == 0)
+			return error_handling(except_e::CERT_LOAD);
+	}
+
+	// Read ahead lets a single recv pull in several records, OpenSSL won't hand receiving to the kernel with it
+	if (opt.readahead > 0 && !opt.ktls) {
+		SSL_CTX_set_read_ahead(ctx, 1);
+		SSL_CTX_set_default_read_buffer_len(ctx, opt.readahead);
+	}
+
+	// Kernel TLS, OpenSSL only switches over if both the kernel and the negotiated cipher support it
+#ifdef SSL_OP_ENABLE_KTLS
+	if (opt.ktls)
+		SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
 #endif
+
+	// Client side session cache, OpenSSL only hands out the sessions and the cache decides when to offer them
+	if (opt.sessioncapacity > 0) {
+		ret->_sessions.reset(new sessioncache(opt.sessioncapacity, opt.sessionlifetime));
+		SSL_CTX_set_ex_data(ctx, context_index(), ret.get());
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ctx, new_session);
+	}
+
+	// Protocols offered through ALPN, in wire format (length prefixed)
+	if (!opt.alpn.empty()) {
+		std::vector<uint8_t> wire;
+		for (const auto& proto : opt.alpn) {
+			if (proto.empty() || proto.size() > 255)
+				return error_handling(except_e::ALPN);
+			wire.push_back(static_cast<uint8_t>(proto.size()));
+			wire.insert(wire.end(), proto.begin(), proto.end());
+		}
+		if (SSL_CTX_set_alpn_protos(ctx, wire.data(), static_cast<unsigned int>(wire.size())) != 0)
+			return error_handling(except_e::ALPN);
+	}
+
+	return ret;
 }
 
-static void close_openssl()
+std::shared_ptr<context> context::shared()
 {
-    if (openssl_stack == 1) {
-		SSL_CTX_free(ctx);
-    }
-	if (openssl_stack >= 1) {
-		--openssl_stack;
-	}
+	// Created once and kept for the life of the process, a failed attempt is retried by the next caller
+	static std::mutex mutex;
+	static std::shared_ptr<context> ctx;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!ctx)
+		ctx = create();
+	return ctx;
+}
+
+SSL_CTX * context::native() const noexcept
+{
+	return _ctx;
+}
+
+sessioncache * context::sessions() const noexcept
+{
+	return _sessions.get();
 }
 
 /*
@@ -118,6 +394,12 @@ const char * exception::what() const noexcept
         return "Writing to over TLS failed";
     case (except_e::READ):
         return "Reading over TLS failed";
+    case (except_e::CONTEXT):
+        return "Failed to create a TLS context";
+    case (except_e::ALPN):
+        return "Invalid ALPN protocol list";
+    case (except_e::TIMEOUT):
+        return "TLS handshake timed out";
     default:
         return "An unkown OpenSSL error occured";    
     }
@@ -125,7 +407,7 @@ const char * exception::what() const noexcept
 
 const char * exception::details() noexcept
 {
-	static std::string msg = "";
+	thread_local std::string msg = "";
 
 	msg.clear();
 	unsigned long err;
@@ -139,197 +421,1082 @@ const char * exception::details() noexcept
 #endif
 
 /*
- * Streambuf class
+ * Engine class
  */
-streambuf::streambuf(SSL *ssl)
-    : tcp::streambuf()
+engine::engine(std::shared_ptr<context> ctx)
+	: _ctx(std::move(ctx))
 {
-	reset(ssl);
 }
 
-streambuf::streambuf()
-	: tcp::streambuf()
+engine::~engine()
 {
+	reset();
 }
 
-void streambuf::readfunc(const void * const t, size_t& res, char *begin, size_t len)
+void engine::connect(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize)
 {
-	// Check for time out and size limit
-	auto ssl = *static_cast<SSL** const>(const_cast<void * const>(t));
-	if (!checksocket(SSL_get_fd(ssl)))
-		return;
-
-    auto ret = SSL_read(ssl, begin, len);
-    if (ret <= 0) {
+	auto cleanup = [this](except_e except) {
+		reset();
 #ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
-        throw exception(except_e::READ);
-#else
-        return;
+		throw (exception(except));
 #endif
-    }
-    res += ret;
+	};
 
-	// Update limits
-	_curread += ret;
-	_begin = std::chrono::high_resolution_clock::now();
+	reset();
+	if (!_ctx)
+		return cleanup(except_e::CONTEXT);
+
+	_ssl = SSL_new(_ctx->native());
+	if (_ssl == nullptr)
+		return cleanup(except_e::SSL_STRUCT);
+	if (!prepare(_ssl, node, protocolList, listSize))
+		return cleanup(except_e::SET_HOSTNAME);
+
+	// An empty input BIO means the peer hasn't sent enough yet, not that it's gone
+	_in = BIO_new(BIO_s_mem());
+	_out = BIO_new(BIO_s_mem());
+	if (_in == nullptr || _out == nullptr) {
+		BIO_free(_in);
+		BIO_free(_out);
+		_in = _out = nullptr;
+		return cleanup(except_e::SSL_SOCK);
+	}
+	BIO_set_mem_eof_return(_in, -1);
+	SSL_set_bio(_ssl, _in, _out);
+	SSL_set_connect_state(_ssl);
+
+	auto sessions = _ctx->sessions();
+	if (sessions)
+		offer(_ssl, sessions, _sessionkey.assign(node).append(":").append(service));
 }
 
-void streambuf::writefunc(const void * const t, size_t& res, char *begin, size_t len)
+engine::status engine::handshake()
 {
-    auto ret = SSL_write(*static_cast<SSL** const>(const_cast<void * const>(t)), begin, len);
-    if (ret < 0) {
-#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
-        throw exception(except_e::WRITE);
-#else
-        return;
-#endif
-    }
-    res += ret;
+	if (_ssl == nullptr)
+		return status::FAILED;
+	if (_established)
+		return status::OK;
+
+	auto ret = SSL_do_handshake(_ssl);
+	auto sessions = _ctx->sessions();
+	if (ret == 1) {
+		_established = true;
+		if (sessions && SSL_session_reused(_ssl))
+			++sessions->_resumed;
+		return status::OK;
+	}
+
+	auto st = _status(ret);
+	if (st == status::FAILED && sessions)
+		sessions->remove(_sessionkey);
+	return st;
 }
 
-/*
- * Client class
- */
-client::client()
+bool engine::established() const noexcept
 {
-#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
-    init_openssl();
-#else
-	if (!init_openssl())
-		this->setstate(std::ios_base::badbit);
-#endif
+	return _established;
 }
 
-client::~client()
+void engine::feed(const char *data, size_t len)
 {
-    _disconnect();
-    close_openssl();
+	if (_in)
+		BIO_write(_in, data, static_cast<int>(len));
 }
 
-bool client::is_open() const noexcept
+size_t engine::pending() const noexcept
 {
-    return _connected;
+	return _out ? BIO_ctrl_pending(_out) : 0;
 }
 
-void client::open(std::string_view node, std::string_view service)
+size_t engine::drain(std::string& out)
 {
-    _disconnect();   
-    _connect(node, service, nullptr, 0);
+	auto n = pending();
+	if (n > 0) {
+		auto old = out.size();
+		out.resize(old+n);
+		BIO_read(_out, &out[old], static_cast<int>(n));
+	}
+	return n;
 }
 
-void client::open(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize)
+engine::status engine::read(char *begin, size_t len, size_t& res)
 {
-    _disconnect();
-    _connect(node, service, protocolList, listSize);
+	if (_ssl == nullptr)
+		return status::FAILED;
+
+	size_t n = 0;
+	auto ret = SSL_read_ex(_ssl, begin, len, &n);
+	if (ret != 1)
+		return _status(ret);
+	res += n;
+	return status::OK;
 }
 
-void client::close()
+engine::status engine::write(const char *begin, size_t len, size_t& res)
 {
-    _disconnect();
+	if (_ssl == nullptr)
+		return status::FAILED;
+
+	size_t n = 0;
+	auto ret = SSL_write_ex(_ssl, begin, len, &n);
+	if (ret != 1)
+		return _status(ret);
+	res += n;
+	return status::OK;
 }
 
-const char * client::getprotocol()
+engine::status engine::shutdown()
 {
-	if (_connected) {
-		auto session = SSL_get_session(_ssl);
-		if (session == nullptr)
-			return "TLS";
+	if (_ssl == nullptr)
+		return status::CLOSED;
 
-		auto id = SSL_SESSION_get_protocol_version(session);
-		if (id == TLS1_2_VERSION)
-			return "TLS 1.2";
-		else
-			return "TLS 1.3";
-	}
-	else {
-		return "Not connnected";
-	}
+	auto ret = SSL_shutdown(_ssl);
+	if (ret == 1)
+		return status::CLOSED;
+	else if (ret == 0)
+		return status::WANT_READ;
+	return _status(ret);
 }
 
-void client::_createsb()
+void engine::reset()
 {
-    // The base class deletes this value
-    _sb = new streambuf();
-    this->set_rdbuf(_sb);
-    this->clear();
+	// Frees the BIOs as well
+	SSL_free(_ssl);
+	_ssl = nullptr;
+	_in = _out = nullptr;
+	_established = false;
 }
 
-void client::_resetsb()
+SSL * engine::native() const noexcept
 {
-    _sb->reset();
-    this->clear();
+	return _ssl;
 }
 
-void client::_connect(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize)
+engine::status engine::_status(int ret)
 {
-    auto cleanup = [this](except_e except) {
-        SSL_free(_ssl);
-        tcp::client::_disconnect();
-#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
-		throw (exception(except));
-#else
-		this->setstate(std::ios_base::badbit);
-#endif
-    };
-
-    // Connect to the server
-    tcp::client::_connect(node, service);
-    if (!_connected) {
-#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
-        throw (exception(except_e::CONNECT));
-#else
-        this->setstate(std::ios_base::badbit);
-        return;
-#endif
-    }
-
-    // Create a new SSL structure
-    _ssl = SSL_new(ctx);
-    if (_ssl == nullptr)
-        return cleanup(except_e::SSL_STRUCT);
-
-	// Make sure the host doesn't contain any cheeky null characters and is not null
-	if (node.length() != std::string(node).length() && std::string(node).length() > 0)
-		return cleanup(except_e::SET_HOSTNAME);
+	switch (SSL_get_error(_ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		return status::WANT_READ;
+	case SSL_ERROR_WANT_WRITE:
+		return status::WANT_WRITE;
+	case SSL_ERROR_ZERO_RETURN:
+		return status::CLOSED;
+	default:
+		return status::FAILED;
+	}
+}
 
-    // Enable certificate validation
-    SSL_set_hostflags(_ssl, X509_CHECK_FLAG_NO_PARTIAL_WILDCARDS);
-	if (SSL_set1_host(_ssl, std::string(node).c_str()) != 1)
-		return cleanup(except_e::SET_HOSTNAME);
-    SSL_set_verify(_ssl, SSL_VERIFY_PEER, nullptr);
+/*
+ * Streambuf class
+ */
+streambuf::streambuf(SSL *ssl)
+    : tcp::streambuf()
+{
+	reset(ssl);
+}
 
-    // Make sure TLS stuff get automatically handled inside SSL_read, instead of having to call SSL_read twice
-    SSL_set_mode(_ssl, SSL_MODE_AUTO_RETRY);
+streambuf::streambuf()
+	: tcp::streambuf()
+{
+}
 
-	// Enables SNI (not required by the standard, but some servers throw a fit if you don't enable it)
-	if (SSL_set_tlsext_host_name(_ssl, std::string(node).c_str()) != 1)
-		return cleanup(except_e::SET_HOSTNAME);
+void streambuf::beginhandshake(unsigned int timeout, sessioncache *sessions) noexcept
+{
+	_hstimeout = timeout;
+	_sessions = sessions;
+	_hsexpired = false;
+	_nonblocking = false;
+	_hsbegin = std::chrono::steady_clock::now();
+}
 
-    // Enables ALPN (required for http/2.0)
-    if (protocolList)
-        SSL_set_alpn_protos(_ssl, protocolList, listSize);
+engine::status streambuf::stephandshake(SSL *ssl)
+{
+	if (_hstimeout > 0 && std::chrono::steady_clock::now()-_hsbegin >= std::chrono::milliseconds(_hstimeout)) {
+		_hsexpired = true;
+		return engine::status::FAILED;
+	}
 
-    // Connect the SSL object with a file descriptor
-	if (SSL_set_fd(_ssl, _socket) != 1)
-		return cleanup(except_e::SSL_SOCK);
+	// The socket stays non-blocking afterwards, reads and writes wait on the socket only when OpenSSL asks for it
+	if (!_nonblocking) {
+		setblocking(SSL_get_fd(ssl), false);
+		_nonblocking = true;
+	}
 
-    // Do the handshake (this also verifies the certificate)
-	if (SSL_connect(_ssl) != 1) 
-		return cleanup(except_e::HANDSHAKE);
+	auto ret = SSL_connect(ssl);
+	if (ret == 1) {
+		_hstime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-_hsbegin);
+		if (_sessions && SSL_session_reused(ssl))
+			++_sessions->_resumed;
+		detectktls(ssl);
+		return engine::status::OK;
+	}
 
-    // Update the streambuf
-    _sb->reset(_ssl);
-    this->clear();
+	switch (SSL_get_error(ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		return engine::status::WANT_READ;
+	case SSL_ERROR_WANT_WRITE:
+		return engine::status::WANT_WRITE;
+	default:
+		return engine::status::FAILED;
+	}
 }
 
-void client::_disconnect()
+bool streambuf::completehandshake(SSL *ssl)
 {
-    if (_connected) {
-        int ret;
-        do {
-            ret = SSL_shutdown(_ssl);
-        } while (ret == 0);
+	while (true) {
+		auto st = stephandshake(ssl);
+		if (st == engine::status::OK)
+			return true;
+		else if (st == engine::status::FAILED)
+			return false;
+
+		// Wait for the socket, the next step notices an expired deadline
+		int timeleft = -1;
+		if (_hstimeout > 0) {
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-_hsbegin).count();
+			timeleft = static_cast<int>(std::max<int64_t>(_hstimeout-elapsed, 0));
+		}
+		pollfd pfd = {static_cast<tcp::socket_t>(SSL_get_fd(ssl)), static_cast<short>(st == engine::status::WANT_READ ? POLLIN : POLLOUT), 0};
+#ifndef WINDOWS
+		poll(&pfd, 1, timeleft);
+#else
+		WSAPoll(&pfd, 1, timeleft);
+#endif
+	}
+}
+
+bool streambuf::handshakeexpired() const noexcept
+{
+	return _hsexpired;
+}
+
+std::chrono::microseconds streambuf::handshaketime() const noexcept
+{
+	return _hstime;
+}
+
+void streambuf::beginearly(uint32_t max)
+{
+	_early = max > 0;
+	_earlyaccepted = false;
+	_earlymax = max;
+	_earlydata.clear();
+	_hstime = std::chrono::microseconds(0);
+}
+
+void streambuf::finishearly(SSL *ssl)
+{
+	if (!_early)
+		return;
+	_early = false;
+
+	// The clock only ran while the early data was written, the application's pause before the first read doesn't count
+	_hsbegin = std::chrono::steady_clock::now()-_hstime;
+	if (!completehandshake(ssl)) {
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+		throw exception(_hsexpired ? except_e::TIMEOUT : except_e::HANDSHAKE);
+#else
+		return;
+#endif
+	}
+
+	// A refused first flight was dropped by the server, so it has to be sent again
+	_earlyaccepted = SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED;
+	if (!_earlyaccepted && !_earlydata.empty()) {
+		if (sslwrite(ssl, _earlydata.data(), _earlydata.size()) <= 0) {
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+			throw exception(except_e::WRITE);
+#else
+			return;
+#endif
+		}
+	}
+	_earlydata.clear();
+}
+
+void streambuf::detectktls(SSL *ssl)
+{
+#if !defined OPENSSL_NO_KTLS && OPENSSL_VERSION_NUMBER >= 0x30000000L
+	_ktlssend = ssl && BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0;
+	_ktlsrecv = ssl && BIO_get_ktls_recv(SSL_get_rbio(ssl)) > 0;
+#else
+	_ktlssend = _ktlsrecv = false;
+#endif
+}
+
+bool streambuf::ktlssend() const noexcept
+{
+	return _ktlssend;
+}
+
+bool streambuf::ktlsrecv() const noexcept
+{
+	return _ktlsrecv;
+}
+
+void streambuf::setrecordpolicy(const recordpolicy& policy) noexcept
+{
+	_policy = policy;
+	_burst = 0;
+}
+
+uint64_t streambuf::records() const noexcept
+{
+	return _records;
+}
+
+size_t streambuf::recordsize(size_t len) noexcept
+{
+	if (!_policy.dynamic)
+		return len;
+
+	// A pause long enough for the congestion window to shrink starts over with small records
+	auto now = std::chrono::steady_clock::now();
+	if (now-_lastwrite >= _policy.idle)
+		_burst = 0;
+	_lastwrite = now;
+
+	auto size = _burst < _policy.threshold ? _policy.small : _policy.large;
+	return std::min(len, std::max<size_t>(size, 1));
+}
+
+bool streambuf::inearly() const noexcept
+{
+	return _early;
+}
+
+bool streambuf::earlyaccepted() const noexcept
+{
+	return _earlyaccepted;
+}
+
+int streambuf::sslwrite(SSL *ssl, const char *begin, size_t len)
+{
+	// The same buffer is passed again once the socket has room, as OpenSSL requires
+	_wbegin = std::chrono::high_resolution_clock::now();
+	int ret;
+	while ((ret = SSL_write(ssl, begin, static_cast<int>(len))) <= 0) {
+		if (SSL_get_error(ssl, ret) != SSL_ERROR_WANT_WRITE || !checkwritable(SSL_get_fd(ssl)))
+			return -1;
+	}
+	return ret;
+}
+
+bool streambuf::closed(int err, int ret) noexcept
+{
+	// A close_notify, or the peer closed the socket without one (OpenSSL 3 reports that as an error of its own)
+	if (err == SSL_ERROR_ZERO_RETURN || (err == SSL_ERROR_SYSCALL && ret == 0 && ERR_peek_error() == 0))
+		return true;
+#ifdef SSL_R_UNEXPECTED_EOF_WHILE_READING
+	if (err == SSL_ERROR_SSL && ERR_GET_REASON(ERR_peek_error()) == SSL_R_UNEXPECTED_EOF_WHILE_READING)
+		return true;
+#endif
+	return false;
+}
+
+#if !defined OPENSSL_NO_KTLS && OPENSSL_VERSION_NUMBER >= 0x30000000L
+ossl_ssize_t streambuf::sslsendfile(SSL *ssl, int fd, int64_t offset, size_t len)
+{
+	// Same deadline as any other write
+	_wbegin = std::chrono::high_resolution_clock::now();
+	ossl_ssize_t ret;
+	while ((ret = SSL_sendfile(ssl, fd, offset, len, 0)) <= 0) {
+		if (SSL_get_error(ssl, static_cast<int>(ret)) != SSL_ERROR_WANT_WRITE || !checkwritable(SSL_get_fd(ssl)))
+			return -1;
+	}
+	return ret;
+}
+#endif
+
+void streambuf::readfunc(const void * const t, size_t& res, char *begin, size_t len)
+{
+	// Nothing can be read before the handshake is done
+	auto ssl = *static_cast<SSL** const>(const_cast<void * const>(t));
+	if (_early)
+		finishearly(ssl);
+
+	// Check the size limit
+	if (_inlimit && _curread >= _maxread)
+		return;
+
+	// Plaintext or records OpenSSL already holds come first, the socket is only polled (with the timeout) when
+	// OpenSSL needs more ciphertext
+	int ret;
+	while ((ret = SSL_read(ssl, begin, len)) <= 0) {
+		auto err = SSL_get_error(ssl, ret);
+		if (err == SSL_ERROR_WANT_READ) {
+			if (!checksocket(SSL_get_fd(ssl)))
+				return;
+		}
+		else if (closed(err, ret)) {
+			// Nothing read is EOF, like a plain socket that was closed
+			ERR_clear_error();
+			return;
+		}
+		else {
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+			throw exception(except_e::READ);
+#else
+			return;
+#endif
+		}
+	}
+    res += ret;
+
+	// Update limits
+	_curread += ret;
+	_begin = std::chrono::high_resolution_clock::now();
+}
+
+void streambuf::writefunc(const void * const t, size_t& res, char *begin, size_t len)
+{
+	auto ssl = *static_cast<SSL** const>(const_cast<void * const>(t));
+
+	// Send as early data while the server's limit allows it, anything beyond that waits for the handshake
+	if (_early) {
+		if (_earlydata.size() + len <= _earlymax) {
+			// The client hello goes out with the first write, that's when the handshake really starts
+			if (_earlydata.empty())
+				_hsbegin = std::chrono::steady_clock::now();
+			size_t written = 0;
+			auto ret = SSL_write_early_data(ssl, begin, len, &written);
+			_hstime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-_hsbegin);
+			if (ret == 1) {
+				_earlydata.append(begin, written);
+				res += written;
+				_records += (written+SSL3_RT_MAX_PLAIN_LENGTH-1)/SSL3_RT_MAX_PLAIN_LENGTH;
+				return;
+			}
+			ERR_clear_error();
+		}
+		finishearly(ssl);
+	}
+
+	// Only part of the data may fit the record, sync calls again for the rest
+	len = recordsize(len);
+
+	// The kernel frames and encrypts the records itself (one per send), so the data can go straight to the socket
+	size_t written = 0;
+	if (_ktlssend) {
+		tcp::socket_t socket = SSL_get_fd(ssl);
+		tcp::streambuf::writefunc(&socket, written, begin, len);
+	}
+	else {
+		auto ret = sslwrite(ssl, begin, len);
+		if (ret < 0) {
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+			throw exception(except_e::WRITE);
+#else
+			return;
+#endif
+		}
+		written = ret;
+	}
+	res += written;
+	_burst += written;
+	_records += (written+SSL3_RT_MAX_PLAIN_LENGTH-1)/SSL3_RT_MAX_PLAIN_LENGTH;
+}
+
+/*
+ * Handshake pool class
+ */
+handshakepool::handshakepool(unsigned int threads, size_t capacity)
+	: _capacity(capacity)
+{
+	for (unsigned int i = 0; i < std::max(threads, 1U); ++i)
+		_workers.emplace_back(&handshakepool::_work, this);
+}
+
+handshakepool::~handshakepool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_cv.notify_all();
+	for (auto& t : _workers)
+		t.join();
+}
+
+bool handshakepool::submit(client& c, std::string_view node, std::string_view service, done_t done)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_stop || _jobs.size() >= _capacity) {
+			++_rejected;
+			return false;
+		}
+		_jobs.push_back({&c, std::string(node), std::string(service), std::move(done)});
+		if (_jobs.size() > _peak)
+			_peak = _jobs.size();
+	}
+	_cv.notify_one();
+	return true;
+}
+
+size_t handshakepool::depth() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _jobs.size();
+}
+
+size_t handshakepool::peak() const noexcept
+{
+	return _peak;
+}
+
+uint64_t handshakepool::completed() const noexcept
+{
+	return _completed;
+}
+
+uint64_t handshakepool::rejected() const noexcept
+{
+	return _rejected;
+}
+
+void handshakepool::_work()
+{
+	while (true) {
+		job j;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_cv.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+			if (_jobs.empty())
+				return;
+			j = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+
+		std::exception_ptr error;
+		try {
+			j.c->open(j.node, j.service);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+		++_completed;
+		if (j.done)
+			j.done(error);
+	}
+}
+
+/*
+ * Client class
+ */
+client::client()
+    : _ctx(context::shared())
+{
+	if (!_ctx)
+		this->setstate(std::ios_base::badbit);
+}
+
+client::client(std::shared_ptr<context> ctx)
+    : _ctx(std::move(ctx))
+{
+	if (!_ctx)
+		this->setstate(std::ios_base::badbit);
+}
+
+client::~client()
+{
+    _disconnect();
+}
+
+void client::setcontext(std::shared_ptr<context> ctx)
+{
+	assert(!_connected);
+	_ctx = std::move(ctx);
+}
+
+const std::shared_ptr<context>& client::getcontext() const noexcept
+{
+	return _ctx;
+}
+
+bool client::is_open() const noexcept
+{
+    return _connected;
+}
+
+void client::open(std::string_view node, std::string_view service)
+{
+    _disconnect();   
+    _connect(node, service, nullptr, 0);
+}
+
+void client::open(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize)
+{
+    _disconnect();
+    _connect(node, service, protocolList, listSize);
+}
+
+void client::close()
+{
+    _disconnect();
+}
+
+const char * client::getprotocol()
+{
+	if (_connected)
+		return protocolname(_ssl);
+	else
+		return "Not connnected";
+}
+
+const char * client::getcipher() const
+{
+	return _connected ? SSL_get_cipher_name(_ssl) : "Not connected";
+}
+
+std::string_view client::getalpn() const
+{
+	const unsigned char *data = nullptr;
+	unsigned int len = 0;
+	if (_connected)
+		SSL_get0_alpn_selected(_ssl, &data, &len);
+	return std::string_view(reinterpret_cast<const char*>(data), len);
+}
+
+bool client::is_stale()
+{
+	if (!_connected)
+		return true;
+	if (static_cast<streambuf*>(_sb)->inearly() || (!tcp::client::is_stale() && SSL_has_pending(_ssl) == 0))
+		return false;
+
+	// The socket is non-blocking after the handshake, so this only processes what already arrived
+	char c;
+	auto ret = SSL_peek(_ssl, &c, 1);
+	if (ret > 0)
+		return true;
+	auto stale = SSL_get_error(_ssl, ret) != SSL_ERROR_WANT_READ;
+	ERR_clear_error();
+	return stale;
+}
+
+void client::enable_early_data(bool enable) noexcept
+{
+	_earlydata = enable;
+}
+
+void client::handshake()
+{
+	if (_connected) {
+		this->flush();
+		static_cast<streambuf*>(_sb)->finishearly(_ssl);
+	}
+}
+
+void client::set_handshake_timeout(unsigned int ms) noexcept
+{
+	_hstimeout = ms;
+}
+
+bool client::open_async(handshakepool& pool, std::string_view node, std::string_view service, handshakepool::done_t done)
+{
+	return pool.submit(*this, node, service, std::move(done));
+}
+
+void client::open_nonblocking(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize)
+{
+	_disconnect();
+	_connect(node, service, protocolList, listSize, false);
+}
+
+engine::status client::handshake_step()
+{
+	if (!_connected)
+		return engine::status::FAILED;
+	if (SSL_is_init_finished(_ssl))
+		return engine::status::OK;
+
+	auto st = static_cast<streambuf*>(_sb)->stephandshake(_ssl);
+	if (st == engine::status::FAILED) {
+		auto sessions = _ctx->sessions();
+		if (sessions)
+			sessions->remove(_sessionkey);
+		SSL_free(_ssl);
+		tcp::client::_disconnect();
+	}
+	return st;
+}
+
+inet::tcp::socket_t client::native_handle() const noexcept
+{
+	return _socket;
+}
+
+void client::set_record_policy(const recordpolicy& policy) noexcept
+{
+	_policy = policy;
+	if (_sb)
+		static_cast<streambuf*>(_sb)->setrecordpolicy(policy);
+}
+
+const recordpolicy& client::get_record_policy() const noexcept
+{
+	return _policy;
+}
+
+uint64_t client::records_written() const noexcept
+{
+	return _sb ? static_cast<streambuf*>(_sb)->records() : 0;
+}
+
+std::chrono::microseconds client::handshake_time() const noexcept
+{
+	return _sb ? static_cast<streambuf*>(_sb)->handshaketime() : std::chrono::microseconds(0);
+}
+
+bool client::early_data_accepted() const noexcept
+{
+	return _connected && static_cast<streambuf*>(_sb)->earlyaccepted();
+}
+
+bool client::ktls_send() const noexcept
+{
+	return _connected && static_cast<streambuf*>(_sb)->ktlssend();
+}
+
+bool client::ktls_recv() const noexcept
+{
+	return _connected && static_cast<streambuf*>(_sb)->ktlsrecv();
+}
+
+size_t client::sendfile(int fd, int64_t offset, size_t size)
+{
+	assert(_connected);
+	handshake();
+	this->flush();
+
+	size_t out = 0;
+#if !defined OPENSSL_NO_KTLS && OPENSSL_VERSION_NUMBER >= 0x30000000L
+	auto sb = static_cast<streambuf*>(_sb);
+	if (sb->ktlssend()) {
+		while (out < size) {
+			auto ret = sb->sslsendfile(_ssl, fd, offset+out, size-out);
+			if (ret < 0) {
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+				throw exception(except_e::WRITE);
+#else
+				this->setstate(std::ios_base::badbit);
+				return out;
+#endif
+			}
+			out += ret;
+		}
+		return out;
+	}
+#endif
+
+	// User space fallback, read the file in chunks and encrypt them as usual
+	char buffer[16*1024];
+	while (out < size) {
+#ifndef WINDOWS
+		auto ret = pread(fd, buffer, std::min(sizeof(buffer), size-out), offset+out);
+#else
+		auto ret = _lseeki64(fd, offset+out, SEEK_SET) < 0 ? -1 : _read(fd, buffer, static_cast<unsigned int>(std::min(sizeof(buffer), size-out)));
+#endif
+		if (ret <= 0)
+			break;
+		this->write(buffer, ret);
+		out += ret;
+	}
+	this->flush();
+	return out;
+}
+
+bool client::enable_zerocopy(size_t)
+{
+	return false;
+}
+
+void client::_createsb()
+{
+    // The base class deletes this value
+    _sb = new streambuf();
+    this->set_rdbuf(_sb);
+    this->clear();
+}
+
+void client::_resetsb()
+{
+    _sb->reset();
+    this->clear();
+}
+
+void client::_connect(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize, bool complete)
+{
+    // Connect to the server
+    tcp::client::_connect(node, service);
+    if (!_connected) {
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+        throw (exception(except_e::CONNECT));
+#else
+        this->setstate(std::ios_base::badbit);
+        return;
+#endif
+    }
+
+    // Create a new SSL structure
+    _ssl = SSL_new(_ctx->native());
+    if (_ssl == nullptr) {
+        tcp::client::_disconnect();
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+        throw (exception(except_e::SSL_STRUCT));
+#else
+        this->setstate(std::ios_base::badbit);
+        return;
+#endif
+    }
+
+	if (!prepare(_ssl, node, protocolList, listSize))
+		return _abort(except_e::SET_HOSTNAME);
+
+    // Make sure TLS stuff get automatically handled inside SSL_read, instead of having to call SSL_read twice
+    SSL_set_mode(_ssl, SSL_MODE_AUTO_RETRY);
+
+    // Connect the SSL object with a file descriptor
+	if (SSL_set_fd(_ssl, _socket) != 1)
+		return _abort(except_e::SSL_SOCK);
+
+	// Offer a previous session for this server, and have new ones stored under the same key
+	auto sessions = _ctx->sessions();
+	if (sessions)
+		offer(_ssl, sessions, _sessionkey.assign(node).append(":").append(service));
+
+	auto sb = static_cast<streambuf*>(_sb);
+	sb->beginhandshake(_hstimeout, sessions);
+	sb->setrecordpolicy(_policy);
+	sb->detectktls(nullptr);
+	sb->reset(_ssl);
+	this->clear();
+
+	// With a session that allows early data the handshake waits for the first flight of application data
+	auto session = SSL_get_session(_ssl);
+	if (complete && _earlydata && session && SSL_SESSION_get_max_early_data(session) > 0) {
+		sb->beginearly(SSL_SESSION_get_max_early_data(session));
+		return;
+	}
+	sb->beginearly(0);
+
+    // Do the handshake (this also verifies the certificate)
+	if (complete && !sb->completehandshake(_ssl)) {
+		if (sessions)
+			sessions->remove(_sessionkey);
+		return _abort(sb->handshakeexpired() ? except_e::TIMEOUT : except_e::HANDSHAKE);
+	}
+}
+
+void client::_abort(except_e except)
+{
+    SSL_free(_ssl);
+    tcp::client::_disconnect();
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+	throw (exception(except));
+#else
+	this->setstate(std::ios_base::badbit);
+#endif
+}
+
+void client::_disconnect()
+{
+    if (_connected) {
+        auto begin = std::chrono::steady_clock::now();
+        if (_teardown == tcp::teardown_e::DEFAULT) {
+            // Wait for the peer's close_notify on the blocking socket
+            setblocking(_socket, true);
+            int ret;
+            do {
+                ret = SSL_shutdown(_ssl);
+            } while (ret == 0);
+        }
+        else if (_teardown != tcp::teardown_e::ABORTIVE) {
+            // Only send ours, the peer's close_notify is left to the half-close (or dropped)
+            SSL_shutdown(_ssl);
+        }
         SSL_free(_ssl);
         tcp::client::_disconnect();
+        _teardowntime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-begin);
     }
+}
+
+/*
+ * Engine streambuf class
+ */
+enginebuf::enginebuf(gconnection<char>& transport, engine *e)
+	: gstreambuf<char>(), _transport(transport), _engine(e)
+{
+}
+
+bool enginebuf::push()
+{
+	if (_engine->pending() == 0)
+		return true;
+
+	_cipher.clear();
+	_engine->drain(_cipher);
+	_transport.write(_cipher.data(), _cipher.size());
+	_transport.flush();
+	return _transport.good();
+}
+
+bool enginebuf::pull()
+{
+	// The record header holds the length, so the engine is always handed whole records
+	char header[5];
+	if (!_transport.read(header, sizeof(header)))
+		return false;
+	auto size = static_cast<size_t>(static_cast<uint8_t>(header[3])) << 8 | static_cast<uint8_t>(header[4]);
+
+	_cipher.assign(header, sizeof(header));
+	_cipher.resize(sizeof(header)+size);
+	if (!_transport.read(&_cipher[sizeof(header)], size))
+		return false;
+	_engine->feed(_cipher.data(), _cipher.size());
+	return true;
+}
+
+int enginebuf::sync()
+{
+	if (gstreambuf<char>::sync() == -1)
+		return -1;
+	return push() ? 0 : -1;
+}
+
+void enginebuf::readfunc(const void * const t, size_t& res, char *begin, size_t len)
+{
+	auto e = *static_cast<engine** const>(const_cast<void * const>(t));
+
+	// Check the size limit, timeouts are up to the transport
+	if (_inlimit && _curread >= _maxread)
+		return;
+
+	while (true) {
+		auto old = res;
+		switch (e->read(begin, len, res)) {
+		case engine::status::OK:
+			_curread += static_cast<unsigned int>(res-old);
+			return;
+		case engine::status::WANT_READ:
+			// Post-handshake messages (like key updates) may need an answer before more data arrives
+			if (!push() || !pull())
+				return;
+			break;
+		case engine::status::CLOSED:
+			return;
+		default:
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+			throw exception(except_e::READ);
+#else
+			return;
+#endif
+		}
+	}
+}
+
+void enginebuf::writefunc(const void * const t, size_t& res, char *begin, size_t len)
+{
+	auto e = *static_cast<engine** const>(const_cast<void * const>(t));
+
+	// The records stay in the engine until sync pushes them
+	if (e->write(begin, len, res) != engine::status::OK) {
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+		throw exception(except_e::WRITE);
+#else
+		return;
+#endif
+	}
+}
+
+/*
+ * Overlay class
+ */
+overlay::overlay(gconnection<char>& transport, std::shared_ptr<context> ctx)
+	: _transport(transport), _engine(std::move(ctx))
+{
+	// The base class deletes this value
+	_sb = new enginebuf(_transport, &_engine);
+	this->set_rdbuf(_sb);
+}
+
+overlay::~overlay()
+{
+	_disconnect();
+}
+
+bool overlay::is_open() const noexcept
+{
+	return _connected;
+}
+
+void overlay::open(std::string_view node, std::string_view service)
+{
+	open(node, service, nullptr, 0);
+}
+
+void overlay::open(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize)
+{
+	_disconnect();
+	if (!_transport.is_open())
+		_transport.open(node, service);
+
+	_engine.connect(node, service, protocolList, listSize);
+	auto sb = static_cast<enginebuf*>(_sb);
+	while (true) {
+		auto st = _engine.handshake();
+		if (!sb->push())
+			st = engine::status::FAILED;
+		if (st == engine::status::OK)
+			break;
+		if (st != engine::status::WANT_READ || !sb->pull()) {
+			_engine.reset();
+#ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
+			throw exception(except_e::HANDSHAKE);
+#else
+			this->setstate(std::ios_base::badbit);
+			return;
+#endif
+		}
+	}
+
+	_sb->reset(&_engine);
+	_connected = true;
+	this->clear();
+}
+
+void overlay::close()
+{
+	_disconnect();
+}
+
+const char * overlay::getprotocol()
+{
+	if (_connected)
+		return protocolname(_engine.native());
+	else
+		return "Not connected";
+}
+
+const char * overlay::getcipher() const
+{
+	return _connected ? SSL_get_cipher_name(_engine.native()) : "Not connected";
+}
+
+engine& overlay::getengine() noexcept
+{
+	return _engine;
+}
+
+void overlay::_disconnect()
+{
+	if (_connected) {
+		// Only our close_notify is sent, waiting for the peer's would block on the transport
+		_engine.shutdown();
+		static_cast<enginebuf*>(_sb)->push();
+		_engine.reset();
+		_sb->reset();
+		_connected = false;
+	}
 }
\ No newline at end of file
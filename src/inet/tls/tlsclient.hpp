@@ -1,14 +1,27 @@
 #pragma once
 
 #include "../tcp/tcpclient.hpp"
+#include "../gconnection.hpp"
 #include <openssl/ssl.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 // If for some inane reason you don't want to use exception handling or want to use standard library exceptions
 //#define INET_TLS_DISABLE_CUSTOM_EXCEPTION
 
 namespace inet::tls
 {
-    enum class except_e { PRNG, TLS_VER, CIPHER, CERT_LOAD, CONNECT, SSL_STRUCT, SET_HOSTNAME, SSL_SOCK, HANDSHAKE, VERIFY, WRITE, READ };
+    enum class except_e { PRNG, TLS_VER, CIPHER, CERT_LOAD, CONNECT, SSL_STRUCT, SET_HOSTNAME, SSL_SOCK, HANDSHAKE, VERIFY, WRITE, READ, CONTEXT, ALPN, TIMEOUT };
 
 #ifndef INET_TLS_DISABLE_CUSTOM_EXCEPTION
     class exception : public std::exception
@@ -25,6 +38,214 @@ namespace inet::tls
     };
 #endif
 
+	// Client side TLS sessions per host, offered again on the next connection to skip the full handshake.
+	// TLS 1.2 sessions are reused until they expire, TLS 1.3 tickets are handed out only once.
+	class sessioncache
+	{
+	public:
+
+		sessioncache(size_t capacity, std::chrono::seconds lifetime);
+
+		sessioncache(const sessioncache& rhs) = delete;
+
+		~sessioncache();
+
+		// Returns a session the caller has to free, or nullptr
+		SSL_SESSION * get(const std::string& key);
+
+		// Takes ownership of the session, the least recently used session is dropped when the cache is full
+		void put(const std::string& key, SSL_SESSION *session);
+
+		void remove(const std::string& key);
+
+		void clear();
+
+		size_t size() const;
+
+		// Connections that were offered a cached session, and those the server actually resumed
+		uint64_t offered() const noexcept;
+		uint64_t resumed() const noexcept;
+
+		// Connections that had nothing to offer
+		uint64_t misses() const noexcept;
+
+	private:
+
+		friend class client;
+
+		friend class streambuf;
+
+		friend class engine;
+
+		struct entry
+		{
+			SSL_SESSION *session;
+
+			std::chrono::steady_clock::time_point expires;
+
+			std::list<std::string>::iterator lru;
+		};
+
+		void _erase(std::map<std::string, entry>::iterator it);
+
+		mutable std::mutex _mutex;
+
+		std::map<std::string, entry> _entries;
+
+		std::list<std::string> _lru;
+
+		size_t _capacity;
+
+		std::chrono::seconds _lifetime;
+
+		std::atomic<uint64_t> _offered = 0;
+
+		std::atomic<uint64_t> _resumed = 0;
+
+		std::atomic<uint64_t> _misses = 0;
+	};
+
+	// OpenSSL client context (ciphers, trusted certificates, ALPN), create it once and share it between clients.
+	// It is reference counted and can be used by clients on any thread.
+	class context
+	{
+	public:
+
+		struct options
+		{
+			options();
+
+			// TLS 1.2 cipher list and TLS 1.3 cipher suites
+			std::string ciphers;
+			std::string ciphersuites;
+
+			int minversion = TLS1_2_VERSION;
+
+			// Load the operating system's trusted root certificates
+			bool systemroots = true;
+
+			// Additional trusted certificates, from a file, a hashed directory or PEM text in memory
+			std::string cafile;
+			std::string capath;
+			std::string capem;
+
+			// Protocols offered through ALPN in order of preference (e.g. "h2", "http/1.1")
+			std::vector<std::string> alpn;
+
+			// Buffer for reading ahead of the current record (0 disables it). It's ignored when ktls is set, because
+			// OpenSSL won't offload receiving to the kernel while reading ahead.
+			size_t readahead = 64*1024;
+
+			// Let the kernel do record encryption after the handshake (kTLS), falls back to user space when unsupported
+			bool ktls = false;
+
+			// Session resumption, a capacity of 0 disables it
+			size_t sessioncapacity = 1024;
+			std::chrono::seconds sessionlifetime = std::chrono::hours(2);
+		};
+
+		context(const context& rhs) = delete;
+
+		~context();
+
+		static std::shared_ptr<context> create(const options& opt = options());
+
+		// The process wide default context, it is set up on first use and never torn down
+		static std::shared_ptr<context> shared();
+
+		SSL_CTX * native() const noexcept;
+
+		// nullptr if session resumption is disabled
+		sessioncache * sessions() const noexcept;
+
+	private:
+
+		context();
+
+		SSL_CTX *_ctx;
+
+		std::unique_ptr<sessioncache> _sessions;
+	};
+
+	// TLS over memory BIOs, ciphertext goes in through feed and comes out through drain so any transport can carry it.
+	// Nothing blocks, every step reports whether it needs more ciphertext from the peer or has some to send.
+	class engine
+	{
+	public:
+
+		enum class status { OK, WANT_READ, WANT_WRITE, CLOSED, FAILED };
+
+		engine(std::shared_ptr<context> ctx = context::shared());
+
+		engine(const engine& rhs) = delete;
+
+		~engine();
+
+		// Sets up a client connection to node, service only identifies the server in the session cache
+		void connect(std::string_view node, std::string_view service = "", const uint8_t *protocolList = nullptr, unsigned int listSize = 0);
+
+		// Advances the handshake, WANT_READ means the output has to be sent and more input is needed
+		status handshake();
+
+		bool established() const noexcept;
+
+		// Hands ciphertext received from the peer to the engine
+		void feed(const char *data, size_t len);
+
+		// Ciphertext waiting to be sent
+		size_t pending() const noexcept;
+
+		// Appends all pending ciphertext to out, so it can be sent with a single write
+		size_t drain(std::string& out);
+
+		// Decrypts up to len bytes into begin and adds the count to res
+		status read(char *begin, size_t len, size_t& res);
+
+		// Encrypts up to len bytes and adds the count to res, the records show up in the pending ciphertext
+		status write(const char *begin, size_t len, size_t& res);
+
+		// Queues a close_notify, CLOSED means the peer's close_notify was received as well
+		status shutdown();
+
+		// Drops the connection without a close_notify
+		void reset();
+
+		SSL * native() const noexcept;
+
+	private:
+
+		status _status(int ret);
+
+		std::shared_ptr<context> _ctx;
+
+		SSL *_ssl = nullptr;
+
+		// Owned by _ssl
+		BIO *_in = nullptr;
+
+		BIO *_out = nullptr;
+
+		bool _established = false;
+
+		std::string _sessionkey;
+	};
+
+	// Record sizes for writes, small records at the start of a burst can be decrypted as soon as their one packet arrives.
+	// Once threshold bytes went out the records grow to the maximum, an idle pause starts a new burst.
+	struct recordpolicy
+	{
+		bool dynamic = false;
+
+		// Small records fit a single tcp segment, including the TLS overhead
+		size_t small = 1400;
+
+		size_t large = 16*1024;
+
+		size_t threshold = 1024*1024;
+
+		std::chrono::milliseconds idle = std::chrono::seconds(1);
+	};
+
     class streambuf : public tcp::streambuf
     {
     public:
@@ -33,21 +254,222 @@ namespace inet::tls
 
 		streambuf();
 
+		// Starts the handshake clock, the handshake fails once timeout ms have passed (0 waits forever)
+		void beginhandshake(unsigned int timeout, sessioncache *sessions = nullptr) noexcept;
+
+		// One non-blocking SSL_connect attempt, WANT_READ and WANT_WRITE say what to wait for on the socket
+		engine::status stephandshake(SSL *ssl);
+
+		// Steps the handshake until it's done, false if it failed or ran out of time
+		bool completehandshake(SSL *ssl);
+
+		bool handshakeexpired() const noexcept;
+
+		std::chrono::microseconds handshaketime() const noexcept;
+
+		// Postpones the handshake, writes go out as early data until max bytes have been sent (0 turns it off)
+		void beginearly(uint32_t max);
+
+		// Completes a postponed handshake, replaying the early data over the normal connection if the server refused it
+		void finishearly(SSL *ssl);
+
+		bool inearly() const noexcept;
+
+		bool earlyaccepted() const noexcept;
+
+		// Checks whether OpenSSL moved the record layer into the kernel after the handshake
+		void detectktls(SSL *ssl);
+
+		bool ktlssend() const noexcept;
+
+		bool ktlsrecv() const noexcept;
+
+		void setrecordpolicy(const recordpolicy& policy) noexcept;
+
+		// Records written since the streambuf was created
+		uint64_t records() const noexcept;
+
+#if !defined OPENSSL_NO_KTLS && OPENSSL_VERSION_NUMBER >= 0x30000000L
+		// SSL_sendfile with the same waiting and deadline as writes, -1 on errors and timeouts
+		ossl_ssize_t sslsendfile(SSL *ssl, int fd, int64_t offset, size_t len);
+#endif
+
     protected:
 
+		// How much of the next write goes into a single record
+		size_t recordsize(size_t len) noexcept;
+
+		// SSL_write that waits for the non-blocking socket, -1 on errors and timeouts
+		int sslwrite(SSL *ssl, const char *begin, size_t len);
+
+		// Whether a failed SSL_read means the peer closed the connection (with or without close_notify)
+		static bool closed(int err, int ret) noexcept;
+
         void readfunc(const void * const t, size_t& res, char *begin, size_t len) override;
 
         void writefunc(const void * const t, size_t& res, char *begin, size_t len) override;
+
+		bool _early = false;
+
+		bool _earlyaccepted = false;
+
+		uint32_t _earlymax = 0;
+
+		sessioncache *_sessions = nullptr;
+
+		unsigned int _hstimeout = 0;
+
+		bool _hsexpired = false;
+
+		bool _nonblocking = false;
+
+		std::chrono::steady_clock::time_point _hsbegin;
+
+		std::chrono::microseconds _hstime = std::chrono::microseconds(0);
+
+		bool _ktlssend = false;
+
+		bool _ktlsrecv = false;
+
+		// Kept for a replay in case the server rejects the early data
+		std::string _earlydata;
+
+		recordpolicy _policy;
+
+		// Bytes written in the current burst
+		size_t _burst = 0;
+
+		std::chrono::steady_clock::time_point _lastwrite;
+
+		uint64_t _records = 0;
     };
 
+    class client;
+
+	// Runs the connects and handshakes of tls clients on a fixed set of threads, so the threads serving established
+	// connections don't stall on key exchanges and certificate checks when many connections (re)connect at once
+	class handshakepool
+	{
+	public:
+
+		typedef std::function<void(std::exception_ptr)> done_t;
+
+		handshakepool(unsigned int threads, size_t capacity = 1024);
+
+		handshakepool(const handshakepool& rhs) = delete;
+
+		// Finishes the queued handshakes first
+		~handshakepool();
+
+		// Queues opening the client, done runs on the worker with the error (nullptr on success). Don't touch the client
+		// until then. Returns false if the queue is full.
+		bool submit(client& c, std::string_view node, std::string_view service, done_t done);
+
+		// Handshakes waiting for a worker, and the most there ever were
+		size_t depth() const;
+		size_t peak() const noexcept;
+
+		uint64_t completed() const noexcept;
+
+		// Submissions turned away because the queue was full
+		uint64_t rejected() const noexcept;
+
+	private:
+
+		struct job
+		{
+			client *c;
+
+			std::string node;
+
+			std::string service;
+
+			done_t done;
+		};
+
+		void _work();
+
+		std::deque<job> _jobs;
+
+		size_t _capacity;
+
+		mutable std::mutex _mutex;
+
+		std::condition_variable _cv;
+
+		bool _stop = false;
+
+		std::atomic<size_t> _peak = 0;
+
+		std::atomic<uint64_t> _completed = 0;
+
+		std::atomic<uint64_t> _rejected = 0;
+
+		std::vector<std::thread> _workers;
+	};
+
     class client : public tcp::client
     {
     public:
     
+        // Uses the process wide default context
         client();
 
+        client(std::shared_ptr<context> ctx);
+
         ~client();
 
+        // Changes the context used by the next connection
+        void setcontext(std::shared_ptr<context> ctx);
+
+        const std::shared_ptr<context>& getcontext() const noexcept;
+
+        // Sends the first writes as TLS 1.3 early data (0-RTT) when the cached session allows it. The handshake then
+        // completes on the first read or on handshake(). Only enable this for requests that are safe to replay.
+        void enable_early_data(bool enable) noexcept;
+
+        // Completes a handshake that was postponed for early data, does nothing otherwise
+        void handshake();
+
+        // Deadline for the TLS handshake in ms (0 waits forever), the tcp connect is not part of it
+        void set_handshake_timeout(unsigned int ms) noexcept;
+
+        // Opens the connection on one of the pool's threads, see handshakepool::submit
+        bool open_async(handshakepool& pool, std::string_view node, std::string_view service, handshakepool::done_t done);
+
+        // Connects the socket and leaves the handshake to handshake_step, for use with an event loop
+        void open_nonblocking(std::string_view node, std::string_view service, const uint8_t *protocolList = nullptr, unsigned int listSize = 0);
+
+        // Advances a handshake started by open_nonblocking, wait until native_handle is readable or writable as asked
+        // before calling it again. FAILED closes the connection, this includes running past the deadline.
+        engine::status handshake_step();
+
+        tcp::socket_t native_handle() const noexcept;
+
+        // How long the last completed handshake took. With early data that's the time spent writing it and waiting for
+        // the handshake on the first read, not the time the application took in between.
+        std::chrono::microseconds handshake_time() const noexcept;
+
+        // Changes how writes are split into records, takes effect immediately
+        void set_record_policy(const recordpolicy& policy) noexcept;
+
+        const recordpolicy& get_record_policy() const noexcept;
+
+        // Records written over all connections of this client
+        uint64_t records_written() const noexcept;
+
+        // Whether the server accepted the early data of the current connection
+        bool early_data_accepted() const noexcept;
+
+        // Whether the kernel encrypts outgoing and decrypts incoming records for the current connection
+        bool ktls_send() const noexcept;
+
+        bool ktls_recv() const noexcept;
+
+        // Flushes the stream and sends size bytes of the file starting at offset, without copying through user space
+        // when kTLS is active. Returns the number of bytes sent.
+        size_t sendfile(int fd, int64_t offset, size_t size);
+
         bool is_open() const noexcept override;
 
         void open(std::string_view node, std::string_view service) override;
@@ -58,16 +480,105 @@ namespace inet::tls
 
 		const char * getprotocol() override;
 
+		// The negotiated cipher suite
+		const char * getcipher() const;
+
+		// The application protocol the server picked from the ALPN list, empty if none
+		std::string_view getalpn() const;
+
+		// Session tickets and other handshake messages don't count, only application data, alerts and closes do
+		bool is_stale() override;
+
+		// Zero-copy is not possible because the data gets encrypted in user space first, so there's no threshold
+		bool enable_zerocopy(size_t = 64*1024) override;
+
     private:
 
         void _createsb() override;
 
         void _resetsb() override;
 
-        void _connect(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize);
+        void _connect(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize, bool complete = true);
+
+        void _abort(except_e except);
 
         void _disconnect();
 
+        std::shared_ptr<context> _ctx;
+
+        bool _earlydata = false;
+
+        unsigned int _hstimeout = 10000;
+
+        recordpolicy _policy;
+
+        // Identifies the server in the session cache (host and service)
+        std::string _sessionkey;
+
         SSL* _ssl;
     };
+
+	// Streambuf that runs an engine on top of another connection
+	class enginebuf : public gstreambuf<char>
+	{
+	public:
+
+		enginebuf(gconnection<char>& transport, engine *e);
+
+		// Sends the pending ciphertext to the transport in one write
+		bool push();
+
+		// Reads one complete record from the transport into the engine, false on end of stream
+		bool pull();
+
+	protected:
+
+		// Writes only encrypt, the records of a whole flush go to the transport together
+		int sync() override;
+
+		void readfunc(const void * const t, size_t& res, char *begin, size_t len) override;
+
+		void writefunc(const void * const t, size_t& res, char *begin, size_t len) override;
+
+		gconnection<char>& _transport;
+
+		engine *_engine;
+
+		std::string _cipher;
+	};
+
+	// TLS client over any connection (unix sockets, shared memory, an already established tcp stream, ...)
+	class overlay : public gconnection<char>
+	{
+	public:
+
+		// The transport has to outlive the overlay
+		overlay(gconnection<char>& transport, std::shared_ptr<context> ctx = context::shared());
+
+		~overlay();
+
+		bool is_open() const noexcept override;
+
+		// Opens the transport unless it's open already, then does the handshake over it for node
+		void open(std::string_view node, std::string_view service) override;
+
+		void open(std::string_view node, std::string_view service, const uint8_t *protocolList, unsigned int listSize);
+
+		// Sends a close_notify, the transport stays open
+		void close() override;
+
+		const char * getprotocol() override;
+
+		const char * getcipher() const;
+
+		engine& getengine() noexcept;
+
+	private:
+
+		void _disconnect();
+
+		gconnection<char>& _transport;
+
+		engine _engine;
+	};
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "unixclient.hpp"
+#include <algorithm>
+#include <cstddef>
+
+#if !(defined _WIN32 || defined WIN32)
+#include <cstring>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace inet::unix;
+
+client::client()
+{
+}
+
+client::~client()
+{
+	_disconnect();
+}
+
+void client::open(std::string_view node, std::string_view service)
+{
+	_disconnect();
+	_connect(node);
+}
+
+void client::close()
+{
+	_disconnect();
+}
+
+const char * client::getprotocol()
+{
+	if (_connected)
+		return "UNIX";
+	else
+		return "Not connected";
+}
+
+void client::_connect(std::string_view path)
+{
+#ifndef WINDOWS
+	// The path has to fit including the terminating null character
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+		this->setstate(std::ios_base::badbit);
+		return;
+	}
+	std::copy(path.begin(), path.end(), addr.sun_path);
+	socklen_t len = sizeof(addr);
+
+	// Abstract sockets start with a null character and aren't null terminated
+	if (path[0] == '@') {
+		addr.sun_path[0] = '\0';
+		len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+	}
+
+	auto s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (s < 0) {
+#ifndef INET_TCP_DISABLE_CUSTOM_EXCEPTION
+		throw tcp::exception();
+#else
+		this->setstate(std::ios_base::badbit);
+		return;
+#endif
+	}
+	if (connect(s, reinterpret_cast<sockaddr*>(&addr), len) < 0) {
+		::close(s);
+		this->setstate(std::ios_base::badbit);
+		return;
+	}
+
+	_attach(s);
+#else
+	this->setstate(std::ios_base::badbit);
+#endif
+}
\ No newline at end of file
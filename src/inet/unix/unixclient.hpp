@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../tcp/tcpclient.hpp"
+
+// Some compilers predefine unix as 1 in their GNU modes
+#ifdef unix
+#undef unix
+#endif
+
+namespace inet::unix
+{
+	// Stream oriented AF_UNIX connection, uses the tcp stream buffer so timeouts and read limits behave the same
+	class client : public tcp::client
+	{
+	public:
+
+		client();
+
+		~client();
+
+		// The node is the socket path (a leading '@' selects the abstract namespace), the service is ignored
+		void open(std::string_view node, std::string_view service = "") override;
+
+		void close() override;
+
+		const char * getprotocol() override;
+
+	private:
+
+		void _connect(std::string_view path);
+	};
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "websocket.hpp"
-#include "tlsclient.hpp"
+#include "../tls/tlsclient.hpp"
+#include "../unix/unixclient.hpp"
 #include <cassert>
 #include <memory>
 #include <algorithm>
@@ -28,16 +29,16 @@ const char *exception::what() const noexcept
 client::client(bool encryption)
 	: _encryption(encryption), _con(nullptr)
 {
-	if (encryption)
-		_con = new tls::client;
-	else
-		_con = new tcp::client;
+	_createcon();
 }
 
 client::client(client&& rhs) noexcept
 {
 	_host = rhs._host;
+	_unixpath = rhs._unixpath;
 	_encryption = rhs._encryption;
+	_dns = rhs._dns;
+	_tlsctx = std::move(rhs._tlsctx);
 	_con = rhs._con;
 	rhs._con = nullptr;
 }
@@ -45,10 +46,7 @@ client::client(client&& rhs) noexcept
 client::client(std::string_view host, bool encryption)
 	: _host(host), _encryption(encryption), _con(nullptr)
 {
-	if (encryption)
-		_con = new tls::client;
-	else
-		_con = new tcp::client;
+	_createcon();
 }
 
 client::~client()
@@ -64,6 +62,12 @@ bool client::isconnected() const
 	return _con->is_open();
 }
 
+bool client::tcpinfo(tcp::info& i) const
+{
+	auto con = dynamic_cast<const tcp::client*>(_con);
+	return con != nullptr && con->getinfo(i);
+}
+
 client& client::sethost(std::string_view host)
 {
 	assert(!_con->is_open());
@@ -76,20 +80,63 @@ client& client::setencryption(bool encryption)
 	assert(!_con->is_open() && encryption != _encryption);
 	delete _con;
 	_encryption = encryption;
-	if (encryption)
-		_con = new tls::client;
-	else
-		_con = new tcp::client;
+	_createcon();
 	return *this;
 }
 
-client& client::connect()
+client& client::setunixpath(std::string_view path)
+{
+	assert(!_con->is_open());
+	delete _con;
+	_unixpath = path;
+	_createcon();
+	return *this;
+}
+
+void client::_createcon()
+{
+	// TLS is not used over unix sockets, the peer is on the same host
+	tcp::client *con;
+	if (!_unixpath.empty())
+		con = new unix::client;
+	else if (_encryption)
+		con = _tlsctx ? new tls::client(_tlsctx) : new tls::client;
+	else
+		con = new tcp::client;
+	con->setdnscache(_dns);
+	_con = con;
+}
+
+client& client::settlscontext(std::shared_ptr<tls::context> ctx)
 {
 	assert(!_con->is_open());
-	if (_encryption)
+	_tlsctx = std::move(ctx);
+	if (_encryption && _unixpath.empty())
+		static_cast<tls::client*>(_con)->setcontext(_tlsctx ? _tlsctx : tls::context::shared());
+	return *this;
+}
+
+client& client::setdnscache(tcp::dnscache *cache)
+{
+	_dns = cache;
+	static_cast<tcp::client*>(_con)->setdnscache(cache);
+	return *this;
+}
+
+void client::_opencon()
+{
+	if (!_unixpath.empty())
+		_con->open(_unixpath, "");
+	else if (_encryption)
 		_con->open(_host, "https");
 	else
 		_con->open(_host, "http");
+}
+
+client& client::connect()
+{
+	assert(!_con->is_open());
+	_opencon();
 
 	if (!_con->is_open())
 		throw exception(except_e::OPEN_FAIL);
@@ -102,10 +149,7 @@ client& client::connect()
 client& client::connect(std::string_view resource)
 {
 	assert(!_con->is_open());
-	if (_encryption)
-		_con->open(_host, "https");
-	else
-		_con->open(_host, "http");
+	_opencon();
 
 	if (!_con->is_open())
 		throw exception(except_e::OPEN_FAIL);
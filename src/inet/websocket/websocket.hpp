@@ -1,9 +1,15 @@
 #pragma once
 
-#include "gconnection.hpp"
+#include "../tcp/tcpclient.hpp"
+#include <memory>
 #include <string_view>
 #include <vector>
 
+namespace inet::tls
+{
+	class context;
+}
+
 namespace inet::websocket
 {
 	enum class except_e { OPEN_FAIL, HANDSHAKE_FAIL, UNKOWN_RSP };
@@ -39,10 +45,22 @@ namespace inet::websocket
 
 		bool isconnected() const;
 
+		// Takes a TCP_INFO snapshot of the underlying connection, returns false if that's not possible
+		bool tcpinfo(tcp::info& i) const;
+
 		client& sethost(std::string_view host);
 
 		client& setencryption(bool encryption);
 
+		// Uses this TLS context instead of the process wide default, nullptr goes back to the default
+		client& settlscontext(std::shared_ptr<tls::context> ctx);
+
+		// Resolves the host through the cache (owned by the caller), nullptr disables it
+		client& setdnscache(tcp::dnscache *cache);
+
+		// Connects through a unix domain socket instead of TCP (the host is still sent), an empty path goes back to TCP
+		client& setunixpath(std::string_view path);
+
 		// Connect without a handshake (you might try this after losing connection to the server)
 		client& connect();
 
@@ -80,10 +98,20 @@ namespace inet::websocket
 
 		void pong(uint32_t mask, unsigned int size);
 
+		void _createcon();
+
+		void _opencon();
+
 		std::string _host;
 
+		std::string _unixpath;
+
 		bool _encryption;
 
+		tcp::dnscache *_dns = nullptr;
+
+		std::shared_ptr<tls::context> _tlsctx;
+
 		gconnection<char> *_con;
 	};
 }
\ No newline at end of file
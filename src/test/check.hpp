@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal assertions for the test programs in this directory, a test returns the failure count from main
+namespace test
+{
+	inline int failures = 0;
+
+	inline void check(bool ok, const char *what, const char *file, int line)
+	{
+		if (!ok) {
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+			failures++;
+		}
+	}
+
+	inline int result(const char *name)
+	{
+		std::printf("%s: %s\n", name, failures == 0 ? "ok" : "FAILED");
+		return failures;
+	}
+}
+
+#define CHECK(cond) test::check(static_cast<bool>(cond), #cond, __FILE__, __LINE__)
\ No newline at end of file
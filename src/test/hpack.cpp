@@ -0,0 +1,68 @@
+#include "../inet/http/hpack.hpp"
+#include "check.hpp"
+#include "rfc7541.hpp"
+#include <string>
+
+using namespace inet::http;
+
+// Every example block of RFC 7541 Appendix C decodes to its fields and leaves the table at the listed size, and the
+// encoder produces the same bytes
+static void examples()
+{
+	for (auto& ex : test::rfc7541::examples()) {
+		hpack::decoder d(ex.tablemax);
+		hpack::encoder e(ex.tablemax);
+		test::rfc7541::configure(e, ex);
+		for (auto& b : ex.blocks) {
+			auto wire = test::rfc7541::unhex(b.hex);
+			hpack::fieldlist fields;
+			CHECK(d.decode(reinterpret_cast<const uint8_t*>(wire.data()), wire.size(), fields));
+			CHECK(fields == b.fields);
+			CHECK(d.gettable().size() == b.tablesize);
+
+			std::string block;
+			e.encode(b.fields, block);
+			CHECK(block == wire);
+			CHECK(e.gettable().size() == b.tablesize);
+		}
+	}
+}
+
+static void huffman()
+{
+	// Every byte value, codes from 5 to 30 bits
+	std::string all;
+	for (int i = 0; i < 512; i++)
+		all += static_cast<char>(i);
+	std::string encoded, decoded;
+	hpack::huffmanencode(all, encoded);
+	CHECK(encoded.size() == hpack::huffmanlength(all));
+	CHECK(hpack::huffmandecode(reinterpret_cast<const uint8_t*>(encoded.data()), encoded.size(), decoded));
+	CHECK(decoded == all);
+
+	// The EOS code and padding longer than 7 bits are errors
+	std::string out;
+	const uint8_t eos[] = { 0xff, 0xff, 0xff, 0xff };
+	CHECK(!hpack::huffmandecode(eos, sizeof(eos), out));
+	const uint8_t padding[] = { 0x1f, 0xff };
+	CHECK(!hpack::huffmandecode(padding, sizeof(padding), out));
+}
+
+static void malformed()
+{
+	// Index 0, an index past the end of the table and a size update above the limit
+	for (const char *hex : { "80", "be", "3fe21f" }) {
+		hpack::decoder d(4096);
+		auto wire = test::rfc7541::unhex(hex);
+		hpack::fieldlist fields;
+		CHECK(!d.decode(reinterpret_cast<const uint8_t*>(wire.data()), wire.size(), fields));
+	}
+}
+
+int main()
+{
+	examples();
+	huffman();
+	malformed();
+	return test::result("hpack");
+}
\ No newline at end of file
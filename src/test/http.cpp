@@ -0,0 +1,174 @@
+#include "../inet/http/client.hpp"
+#include "check.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace inet;
+
+// A scripted HTTP/1.1 peer over a unix socket, the request path picks the response
+
+static std::atomic<int> connections = 0;
+
+static void reply(int s, const std::string& path)
+{
+	std::string out;
+	if (path == "/both")
+		out = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n";
+	else if (path == "/304")
+		out = "HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n";
+	else if (path == "/close")
+		out = "HTTP/1.1 200 OK\r\n\r\nuntil the end";
+	else
+		out = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+	send(s, out.data(), out.size(), MSG_NOSIGNAL);
+	if (path == "/close")
+		shutdown(s, SHUT_WR);
+}
+
+static void serve(int s)
+{
+	std::string in;
+	char buffer[4096];
+	while (true) {
+		auto end = in.find("\r\n\r\n");
+		if (end != std::string::npos) {
+			auto path = in.substr(in.find(' ')+1);
+			reply(s, path.substr(0, path.find(' ')));
+			in.erase(0, end+4);
+			continue;
+		}
+		auto n = recv(s, buffer, sizeof(buffer), 0);
+		if (n <= 0)
+			break;
+		in.append(buffer, n);
+	}
+	close(s);
+}
+
+static void peer(int listener)
+{
+	std::vector<std::thread> threads;
+	int s;
+	while ((s = accept(listener, nullptr, nullptr)) >= 0) {
+		connections++;
+		threads.emplace_back(serve, s);
+	}
+	for (auto& t : threads)
+		t.join();
+}
+
+static std::string body(const http::response& r)
+{
+	return std::string(r.body.begin(), r.body.end());
+}
+
+// Chunked coding wins over Content-Length, 304 has no body whatever its headers say, and a HTTP/1.1 body without a
+// length lasts until the close. Every one of them leaves the next response intact.
+static void framing(const std::string& path)
+{
+	http::client c("localhost", false);
+	c.setunixpath(path);
+	http::response r;
+
+	c.send(http::method_e::GET, "/both").retrieve(r);
+	CHECK(body(r) == "abcde");
+	c.send(http::method_e::GET, "/ok").retrieve(r);
+	CHECK(body(r) == "ok");
+
+	c.send(http::method_e::GET, "/304").retrieve(r);
+	CHECK(r.status == http::status_e::NOT_MODIFIED);
+	CHECK(r.body.empty());
+	c.send(http::method_e::GET, "/ok").retrieve(r);
+	CHECK(body(r) == "ok");
+	CHECK(connections == 1);
+
+	c.send(http::method_e::GET, "/close").retrieve(r);
+	CHECK(body(r) == "until the end");
+	c.send(http::method_e::GET, "/ok").retrieve(r);
+	CHECK(body(r) == "ok");
+	CHECK(connections == 2);
+}
+
+// The sink gets the body in pieces no larger than asked for, pieces of 0 bytes are refused before anything is read
+static void sinking(const std::string& path)
+{
+	http::client c("localhost", false);
+	c.setunixpath(path);
+	http::response r;
+
+	std::string received;
+	size_t largest = 0;
+	auto sink = [&](const char *data, size_t size) {
+		received.append(data, size);
+		largest = std::max(largest, size);
+		return true;
+	};
+	c.send(http::method_e::GET, "/both");
+	bool refused = false;
+	try {
+		c.retrieve(r, sink, 0);
+	}
+	catch (const http::exception& e) {
+		refused = e.ecode == http::except_e::INVALID_ARG;
+	}
+	CHECK(refused);
+	c.retrieve(r, sink, 2);
+	CHECK(received == "abcde");
+	CHECK(largest == 2);
+}
+
+// A streamed body can't be written while earlier responses are outstanding, the earlier response is unharmed
+static void streaming(const std::string& path)
+{
+	http::client c("localhost", false);
+	c.setunixpath(path);
+	http::response r;
+
+	c.send(http::method_e::GET, "/ok");
+	bool refused = false;
+	try {
+		c.send(http::message(http::method_e::POST, "localhost"), [](char*, size_t) { return size_t(0); });
+	}
+	catch (const http::exception& e) {
+		refused = e.ecode == http::except_e::PENDING_RSP;
+	}
+	CHECK(refused);
+	c.retrieve(r);
+	CHECK(body(r) == "ok");
+}
+
+int main()
+{
+	std::string path = "/tmp/inet-test-http-" + std::to_string(getpid()) + ".sock";
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+	bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+	listen(listener, 4);
+	std::thread server(peer, listener);
+
+	bool thrown = false;
+	try {
+		framing(path);
+		sinking(path);
+		streaming(path);
+	}
+	catch (const std::exception&) {
+		thrown = true;
+	}
+	CHECK(!thrown);
+
+	shutdown(listener, SHUT_RDWR);
+	server.join();
+	close(listener);
+	unlink(path.c_str());
+	return test::result("http");
+}
\ No newline at end of file
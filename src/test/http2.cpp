@@ -0,0 +1,159 @@
+#include "../inet/http2/client.hpp"
+#include "check.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace inet;
+
+// A scripted HTTP/2 peer (prior knowledge over a unix socket), just enough to send GOAWAY and close on the client
+
+struct frame
+{
+	uint8_t type = 0;
+	uint8_t flags = 0;
+	uint32_t stream = 0;
+	std::string payload;
+};
+
+static bool readall(int s, void *data, size_t len)
+{
+	for (size_t in = 0; in < len; ) {
+		auto n = recv(s, static_cast<char*>(data)+in, len-in, 0);
+		if (n <= 0)
+			return false;
+		in += n;
+	}
+	return true;
+}
+
+static bool readframe(int s, frame& f)
+{
+	uint8_t header[9];
+	if (!readall(s, header, sizeof(header)))
+		return false;
+	f.type = header[3];
+	f.flags = header[4];
+	f.stream = (static_cast<uint32_t>(header[5] & 0x7f) << 24) | (header[6] << 16) | (header[7] << 8) | header[8];
+	f.payload.resize((header[0] << 16) | (header[1] << 8) | header[2]);
+	return readall(s, f.payload.data(), f.payload.size());
+}
+
+static void writeframe(int s, uint8_t type, uint8_t flags, uint32_t stream, const std::string& payload = "")
+{
+	std::string out;
+	out += static_cast<char>(payload.size() >> 16);
+	out += static_cast<char>(payload.size() >> 8);
+	out += static_cast<char>(payload.size());
+	out += static_cast<char>(type);
+	out += static_cast<char>(flags);
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out += static_cast<char>(stream >> shift);
+	out += payload;
+	send(s, out.data(), out.size(), MSG_NOSIGNAL);
+}
+
+static std::string goaway(uint32_t last)
+{
+	std::string payload;
+	for (int shift = 24; shift >= 0; shift -= 8)
+		payload += static_cast<char>(last >> shift);
+	return payload.append(4, '\0');
+}
+
+// Accepts the connection, reads the preface and answers with our SETTINGS
+static int accept_h2(int listener)
+{
+	int s = accept(listener, nullptr, nullptr);
+	char preface[24];
+	readall(s, preface, sizeof(preface));
+	writeframe(s, 4, 0, 0);
+	return s;
+}
+
+// The next HEADERS frame, the stream id it opened (0 if the client went away)
+static uint32_t request(int s)
+{
+	frame f;
+	while (readframe(s, f)) {
+		if (f.type == 1)
+			return f.stream;
+	}
+	return 0;
+}
+
+// Sends GOAWAY and closes our side like a server that shuts down gracefully, then waits for the client to leave
+static void leave(int s, uint32_t last)
+{
+	writeframe(s, 7, 0, 0, goaway(last));
+	shutdown(s, SHUT_WR);
+	frame f;
+	while (readframe(s, f)) {
+	}
+	close(s);
+}
+
+static void peer(int listener)
+{
+	// The first connection goes away before it processes the request, so the request is sent again
+	int s = accept_h2(listener);
+	request(s);
+	leave(s, 0);
+
+	// The second one answers (":status 200" is static table entry 8), then goes away
+	s = accept_h2(listener);
+	auto id = request(s);
+	writeframe(s, 1, 0x5, id, "\x88");
+	leave(s, id);
+
+	// The third one answers a PING and waits for the client to leave
+	s = accept_h2(listener);
+	frame f;
+	while (readframe(s, f) && f.type != 6) {
+	}
+	writeframe(s, 6, 0x1, 0, f.payload);
+	while (readframe(s, f)) {
+	}
+	close(s);
+}
+
+int main()
+{
+	std::string path = "/tmp/inet-test-h2-" + std::to_string(getpid()) + ".sock";
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+	bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+	listen(listener, 4);
+	std::thread server(peer, listener);
+
+	bool thrown = false;
+	{
+		http2::client c("localhost", false);
+		c.setunixpath(path);
+		try {
+			http::response r;
+			c.retrieve(c.send(http::method_e::GET, "/"), r);
+			CHECK(r.status == http::status_e::OK);
+
+			// The connection that went away is replaced for the PING
+			c.ping();
+		}
+		catch (const std::exception&) {
+			thrown = true;
+		}
+	}
+	CHECK(!thrown);
+
+	// Wakes up the peer if the client gave up early
+	shutdown(listener, SHUT_RDWR);
+	server.join();
+	close(listener);
+	unlink(path.c_str());
+	return test::result("http2");
+}
\ No newline at end of file
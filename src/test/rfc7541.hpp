@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../inet/http/hpack.hpp"
+#include <string>
+#include <vector>
+
+// The header block examples of RFC 7541 Appendix C, for the hpack test and benchmark
+namespace test::rfc7541
+{
+	struct block
+	{
+		const char *hex;
+
+		inet::http::hpack::fieldlist fields;
+
+		// Size of the dynamic table after the block
+		uint32_t tablesize;
+	};
+
+	// A sequence of blocks sharing one table
+	struct example
+	{
+		const char *name;
+
+		uint32_t tablemax;
+
+		bool huffman;
+
+		std::vector<block> blocks;
+
+		// Representations the encoder wouldn't pick on its own
+		std::vector<std::pair<const char*, inet::http::hpack::index_e>> policies;
+	};
+
+	inline std::string unhex(const char *hex)
+	{
+		std::string ret;
+		for (; hex[0] && hex[1]; hex += 2)
+			ret += static_cast<char>(std::stoi(std::string(hex, 2), nullptr, 16));
+		return ret;
+	}
+
+	inline std::vector<example> examples()
+	{
+		inet::http::hpack::fieldlist request1 = { { ":method", "GET" }, { ":scheme", "http" }, { ":path", "/" },
+			{ ":authority", "www.example.com" } };
+		auto request2 = request1;
+		request2.push_back({ "cache-control", "no-cache" });
+		inet::http::hpack::fieldlist request3 = { { ":method", "GET" }, { ":scheme", "https" }, { ":path", "/index.html" },
+			{ ":authority", "www.example.com" }, { "custom-key", "custom-value" } };
+
+		inet::http::hpack::fieldlist response1 = { { ":status", "302" }, { "cache-control", "private" },
+			{ "date", "Mon, 21 Oct 2013 20:13:21 GMT" }, { "location", "https://www.example.com" } };
+		auto response2 = response1;
+		response2[0].second = "307";
+		inet::http::hpack::fieldlist response3 = { { ":status", "200" }, { "cache-control", "private" },
+			{ "date", "Mon, 21 Oct 2013 20:13:22 GMT" }, { "location", "https://www.example.com" },
+			{ "content-encoding", "gzip" }, { "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" } };
+
+		// The responses index the fields that change with every message, which the encoder doesn't do by default
+		std::vector<std::pair<const char*, inet::http::hpack::index_e>> dated = { { "date", inet::http::hpack::index_e::INDEX },
+			{ "set-cookie", inet::http::hpack::index_e::INDEX } };
+
+		return {
+			{ "C.2.1", 4096, false, { { "400a637573746f6d2d6b65790d637573746f6d2d686561646572",
+				{ { "custom-key", "custom-header" } }, 55 } } },
+			{ "C.2.2", 4096, false, { { "040c2f73616d706c652f70617468", { { ":path", "/sample/path" } }, 0 } },
+				{ { ":path", inet::http::hpack::index_e::LITERAL } } },
+			{ "C.2.3", 4096, false, { { "100870617373776f726406736563726574", { { "password", "secret" } }, 0 } },
+				{ { "password", inet::http::hpack::index_e::NEVER } } },
+			{ "C.2.4", 4096, false, { { "82", { { ":method", "GET" } }, 0 } } },
+			{ "C.3", 4096, false, {
+				{ "828684410f7777772e6578616d706c652e636f6d", request1, 57 },
+				{ "828684be58086e6f2d6361636865", request2, 110 },
+				{ "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565", request3, 164 } } },
+			{ "C.4", 4096, true, {
+				{ "828684418cf1e3c2e5f23a6ba0ab90f4ff", request1, 57 },
+				{ "828684be5886a8eb10649cbf", request2, 110 },
+				{ "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf", request3, 164 } } },
+			{ "C.5", 256, false, {
+				{ "4803333032580770726976617465611d4d6f6e2c203231204f637420323031332032303a31333a323120474d546e17"
+					"68747470733a2f2f7777772e6578616d706c652e636f6d", response1, 222 },
+				{ "4803333037c1c0bf", response2, 222 },
+				{ "88c1611d4d6f6e2c203231204f637420323031332032303a31333a323220474d54c05a04677a69707738666f6f3d41"
+					"53444a4b48514b425a584f5157454f50495541585157454f49553b206d61782d6167653d333630303b207665727369"
+					"6f6e3d31", response3, 215 } }, dated },
+			{ "C.6", 256, true, {
+				{ "488264025885aec3771a4b6196d07abe941054d444a8200595040b8166e082a62d1bff6e919d29ad171863c78f0b97"
+					"c8e9ae82ae43d3", response1, 222 },
+				{ "4883640effc1c0bf", response2, 222 },
+				{ "88c16196d07abe941054d444a8200595040b8166e084a62d1bffc05a839bd9ab77ad94e7821dd7f2e6c7b335dfdfcd5b"
+					"3960d5af27087f3672c1ab270fb5291f9587316065c003ed4ee5b1063d5007", response3, 215 } }, dated }
+		};
+	}
+
+	inline void configure(inet::http::hpack::encoder& e, const example& ex)
+	{
+		e.sethuffman(ex.huffman);
+		for (auto& p : ex.policies)
+			e.setpolicy(p.first, p.second);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "../inet/shm/shmclient.hpp"
+#include "check.hpp"
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace inet;
+
+// Attaching to a ring pair whose header says the capacity is this has to fail
+static void corrupt(uint32_t capacity)
+{
+	shm::client owner;
+	owner.create("", 4096);
+	auto header = static_cast<uint32_t*>(mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, owner.fd(), 0));
+	header[1] = capacity;
+	munmap(header, 4096);
+
+	shm::client peer;
+	bool rejected = false;
+	try {
+		peer.open(owner.fd());
+	}
+	catch (const shm::exception& e) {
+		rejected = e.ecode == shm::except_e::LAYOUT;
+	}
+	CHECK(rejected);
+	CHECK(!peer.is_open());
+}
+
+// Round trips over an anonymous ring pair, the peer on another thread echoes everything back
+int main()
+{
+	shm::client a;
+	a.create("", 64*1024);
+	CHECK(a.is_open());
+
+	shm::client b;
+	b.open(a.fd());
+	CHECK(b.is_open());
+	std::thread peer([&b] {
+		// Lines come back as they are, "big <n>" is followed by n bytes that are echoed in pieces
+		std::string line;
+		while (std::getline(b, line)) {
+			if (line.compare(0, 4, "big ") == 0) {
+				std::vector<char> buffer(16*1024);
+				for (size_t left = std::stoul(line.substr(4)); left > 0; ) {
+					auto n = std::min(left, buffer.size());
+					b.read(buffer.data(), n);
+					b.write(buffer.data(), n);
+					b.flush();
+					left -= n;
+				}
+			}
+			else
+				b << line << '\n' << std::flush;
+		}
+		b.close();
+	});
+
+	a.enable_timeout(5000);
+	for (int i = 0; i < 1000; i++) {
+		std::string line;
+		a << "message " << i << '\n' << std::flush;
+		std::getline(a, line);
+		CHECK(line == "message " + std::to_string(i));
+	}
+
+	// Larger than the ring and the stream buffer, so it wraps around while the peer drains it
+	std::string big(1024*1024, '\0');
+	for (size_t i = 0; i < big.size(); i++)
+		big[i] = static_cast<char>('a'+i%26);
+	std::thread writer([&a, &big] {
+		a << "big " << big.size() << '\n';
+		a.write(big.data(), big.size());
+		a.flush();
+	});
+	std::string back(big.size(), '\0');
+	a.read(back.data(), back.size());
+	writer.join();
+	CHECK(back == big);
+
+	// Closing one side is EOF for the other
+	a.close();
+	peer.join();
+	CHECK(!b.is_open());
+
+	corrupt(0);
+	corrupt(3);
+	corrupt(1u << 30);
+	return test::result("shm");
+}
\ No newline at end of file
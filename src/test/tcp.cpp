@@ -0,0 +1,33 @@
+#include "../inet/tcp/tcpserver.hpp"
+#include "check.hpp"
+#include <string>
+#include <unistd.h>
+
+using namespace inet;
+
+// A single write larger than the stream's output buffer goes out whole, the buffer is written as often as it fills up
+int main()
+{
+	// A write that doesn't make progress would spin instead of failing
+	alarm(30);
+
+	const std::string big(1024*1024, 'x');
+	tcp::server server;
+	server.start("127.0.0.1", "18202", 1, [&big](tcp::client& c) {
+		std::string in(big.size(), '\0');
+		c.read(in.data(), in.size());
+		c.put(in == big ? 'y' : 'n').flush();
+	});
+
+	tcp::client c;
+	c.open("127.0.0.1", "18202");
+	c.enable_timeout(5000);
+	c.write(big.data(), big.size());
+	c.flush();
+	CHECK(c.good());
+	CHECK(c.get() == 'y');
+	c.close();
+
+	server.stop();
+	return test::result("tcp");
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "../inet/tcp/tcpserver.hpp"
+#include "check.hpp"
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace inet;
+
+// Echo round trips through tcp::server on loopback, from several clients at once
+int main()
+{
+	tcp::server server;
+	server.start("127.0.0.1", "18201", 2, [](tcp::client& c) {
+		std::string line;
+		while (std::getline(c, line)) {
+			c << line << '\n';
+			c.flush();
+		}
+	});
+	CHECK(server.is_running());
+
+	// A worker serves one connection at a time, the clients that land on a busy worker wait in its backlog
+	std::mutex lock;
+	std::vector<std::thread> clients;
+	for (int i = 0; i < 4; i++) {
+		clients.emplace_back([&, i] {
+			tcp::client c;
+			c.open("127.0.0.1", "18201");
+			c.enable_timeout(5000);
+			for (int round = 0; round < 10; round++) {
+				auto expected = "client " + std::to_string(i) + " round " + std::to_string(round);
+				std::string line;
+				c << expected << '\n' << std::flush;
+				std::getline(c, line);
+				std::lock_guard<std::mutex> guard(lock);
+				CHECK(line == expected);
+			}
+			c.close();
+		});
+	}
+	for (auto& t : clients)
+		t.join();
+
+	server.stop();
+	CHECK(!server.is_running());
+	CHECK(server.accepted() == 4);
+	return test::result("tcpserver");
+}
\ No newline at end of file
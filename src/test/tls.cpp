@@ -0,0 +1,155 @@
+#include "../inet/tls/tlsclient.hpp"
+#include "check.hpp"
+#include "tlsserver.hpp"
+#include <atomic>
+#include <iterator>
+#include <string>
+#include <thread>
+
+using namespace inet;
+
+static std::shared_ptr<tls::context> trusting(const test::tlsserver& server)
+{
+	tls::context::options opt;
+	opt.systemroots = false;
+	opt.capem = server.ca();
+	return tls::context::create(opt);
+}
+
+// A body that ends with the connection (HTTP/1.0 style) has to read as EOF, whether the server sends close_notify or
+// just closes the socket
+static void closing()
+{
+	std::atomic<bool> notify = true;
+	test::tlsserver server([&notify](SSL *ssl, std::string_view) {
+		std::string response = "HTTP/1.0 200 OK\r\n\r\n" + std::string(100*1024, 'b');
+		SSL_write(ssl, response.data(), static_cast<int>(response.size()));
+		if (notify)
+			SSL_shutdown(ssl);
+	});
+	auto ctx = trusting(server);
+
+	for (bool clean : { true, false }) {
+		notify = clean;
+		tls::client c(ctx);
+		c.open("localhost", server.port());
+		CHECK(c.is_open());
+		c.enable_timeout(5000);
+		std::string response;
+		bool thrown = false;
+		try {
+			response.assign(std::istreambuf_iterator<char>(c), std::istreambuf_iterator<char>());
+		}
+		catch (const std::exception&) {
+			thrown = true;
+		}
+		CHECK(!thrown);
+		CHECK(response == "HTTP/1.0 200 OK\r\n\r\n" + std::string(100*1024, 'b'));
+		c.close();
+	}
+}
+
+// Reconnects offer the cached session and the server resumes it, for both versions
+static void resuming(int version)
+{
+	test::tlsserver::options opt;
+	opt.minversion = opt.maxversion = version;
+	test::tlsserver server([](SSL *ssl, std::string_view) {
+		SSL_write(ssl, "x", 1);
+		SSL_shutdown(ssl);
+	}, opt);
+	auto ctx = trusting(server);
+
+	for (int i = 0; i < 3; i++) {
+		tls::client c(ctx);
+		c.open("localhost", server.port());
+		CHECK(c.is_open());
+		c.enable_timeout(5000);
+		CHECK(c.get() == 'x');
+		c.close();
+	}
+	CHECK(server.handshakes() == 3);
+	CHECK(server.resumed() == 2);
+	CHECK(ctx->sessions()->misses() == 1);
+	CHECK(ctx->sessions()->offered() == 2);
+	CHECK(ctx->sessions()->resumed() == 2);
+}
+
+// The request goes out as early data on a resumed connection, the pause before reading the response isn't part of the
+// handshake time
+static void early()
+{
+	test::tlsserver::options opt;
+	opt.minversion = TLS1_3_VERSION;
+	opt.earlydata = 16*1024;
+	test::tlsserver server([](SSL *ssl, std::string_view early) {
+		std::string request(early);
+		char buffer[1024];
+		int n;
+		while (request.find('\n') == std::string::npos && (n = SSL_read(ssl, buffer, sizeof(buffer))) > 0)
+			request.append(buffer, n);
+		SSL_write(ssl, request.data(), static_cast<int>(request.size()));
+		SSL_shutdown(ssl);
+	}, opt);
+	auto ctx = trusting(server);
+
+	for (int i = 0; i < 2; i++) {
+		tls::client c(ctx);
+		c.enable_early_data(true);
+		c.open("localhost", server.port());
+		c.enable_timeout(5000);
+		c << "request " << i << '\n' << std::flush;
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		std::string line;
+		std::getline(c, line);
+		CHECK(line == "request " + std::to_string(i));
+		CHECK(c.early_data_accepted() == (i > 0));
+		CHECK(c.handshake_time() < std::chrono::milliseconds(200));
+		c.close();
+	}
+	CHECK(server.earlyaccepted() == 1);
+}
+
+// TLS through the engine over a plain tcp connection, lines and a message larger than the stream buffer are echoed
+static void overlaid()
+{
+	test::tlsserver server([](SSL *ssl, std::string_view) {
+		char buffer[16*1024];
+		int n;
+		while ((n = SSL_read(ssl, buffer, sizeof(buffer))) > 0)
+			SSL_write(ssl, buffer, n);
+		SSL_shutdown(ssl);
+	});
+	auto ctx = trusting(server);
+
+	tcp::client transport;
+	transport.open("localhost", server.port());
+	transport.enable_timeout(5000);
+	tls::overlay o(transport, ctx);
+	o.open("localhost", server.port());
+	CHECK(o.is_open());
+	for (int i = 0; i < 100; i++) {
+		std::string line;
+		o << "message " << i << '\n' << std::flush;
+		std::getline(o, line);
+		CHECK(line == "message " + std::to_string(i));
+	}
+
+	std::string big(64*1024, 'o'), back(big.size(), '\0');
+	o.write(big.data(), big.size());
+	o.flush();
+	o.read(back.data(), back.size());
+	CHECK(back == big);
+	o.close();
+	transport.close();
+}
+
+int main()
+{
+	closing();
+	resuming(TLS1_2_VERSION);
+	resuming(TLS1_3_VERSION);
+	early();
+	overlaid();
+	return test::result("tls");
+}
\ No newline at end of file
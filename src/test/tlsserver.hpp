@@ -0,0 +1,221 @@
+#pragma once
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// In-process OpenSSL server for the tls tests and benchmarks. It makes up its own CA and a certificate for localhost
+// on startup, so nothing has to be set up beforehand. Connections are served one after another on a single thread.
+namespace test
+{
+	class tlsserver
+	{
+	public:
+
+		struct options
+		{
+			options();
+
+			// 0 allows the newest version OpenSSL knows
+			int minversion = TLS1_2_VERSION;
+			int maxversion = 0;
+
+			// Empty keeps OpenSSL's defaults
+			std::string ciphers;
+			std::string ciphersuites;
+
+			// Largest TLS 1.3 early data accepted (0 refuses it)
+			uint32_t earlydata = 0;
+		};
+
+		// Runs with the accepted connection after the handshake, early data has already been read from it
+		typedef std::function<void(SSL *ssl, std::string_view early)> handler_t;
+
+		tlsserver(handler_t handler, const options& opt = options())
+			: _handler(std::move(handler)), _earlydata(opt.earlydata)
+		{
+			auto cakey = EVP_RSA_gen(2048), key = EVP_RSA_gen(2048);
+			auto ca = certificate(cakey, cakey, nullptr, "inet test CA");
+			auto cert = certificate(key, cakey, ca, "localhost");
+
+			auto bio = BIO_new(BIO_s_mem());
+			PEM_write_bio_X509(bio, ca);
+			char *data;
+			auto size = BIO_get_mem_data(bio, &data);
+			_ca.assign(data, size);
+			BIO_free(bio);
+
+			_ctx = SSL_CTX_new(TLS_server_method());
+			SSL_CTX_use_certificate(_ctx, cert);
+			SSL_CTX_use_PrivateKey(_ctx, key);
+			SSL_CTX_set_dh_auto(_ctx, 1);
+			SSL_CTX_set_min_proto_version(_ctx, opt.minversion);
+			SSL_CTX_set_max_proto_version(_ctx, opt.maxversion);
+			if ((!opt.ciphers.empty() && SSL_CTX_set_cipher_list(_ctx, opt.ciphers.c_str()) != 1) ||
+				(!opt.ciphersuites.empty() && SSL_CTX_set_ciphersuites(_ctx, opt.ciphersuites.c_str()) != 1))
+				throw std::runtime_error("tlsserver: bad cipher list");
+			SSL_CTX_set_max_early_data(_ctx, opt.earlydata);
+			X509_free(ca);
+			X509_free(cert);
+			EVP_PKEY_free(cakey);
+			EVP_PKEY_free(key);
+
+			// Loopback on an ephemeral port
+			_listener = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in addr = {};
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			socklen_t len = sizeof(addr);
+			if (bind(_listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(_listener, 128) != 0)
+				throw std::runtime_error("tlsserver: can't listen");
+			getsockname(_listener, reinterpret_cast<sockaddr*>(&addr), &len);
+			_port = std::to_string(ntohs(addr.sin_port));
+
+			_thread = std::thread(&tlsserver::_run, this);
+		}
+
+		tlsserver(const tlsserver& rhs) = delete;
+
+		~tlsserver()
+		{
+			// Wakes up the accept
+			shutdown(_listener, SHUT_RDWR);
+			_thread.join();
+			close(_listener);
+			SSL_CTX_free(_ctx);
+		}
+
+		const std::string& port() const noexcept
+		{
+			return _port;
+		}
+
+		// The CA certificate (PEM) clients have to trust
+		const std::string& ca() const noexcept
+		{
+			return _ca;
+		}
+
+		SSL_CTX * native() const noexcept
+		{
+			return _ctx;
+		}
+
+		// Completed handshakes, those that resumed a session and those that accepted early data
+		uint64_t handshakes() const noexcept
+		{
+			return _handshakes;
+		}
+
+		uint64_t resumed() const noexcept
+		{
+			return _resumed;
+		}
+
+		uint64_t earlyaccepted() const noexcept
+		{
+			return _earlyaccepted;
+		}
+
+	private:
+
+		static X509 * certificate(EVP_PKEY *key, EVP_PKEY *signer, X509 *issuer, const char *name)
+		{
+			static std::atomic<long> serial = 1;
+			auto cert = X509_new();
+			X509_set_version(cert, 2);
+			ASN1_INTEGER_set(X509_get_serialNumber(cert), serial++);
+			X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+			X509_gmtime_adj(X509_getm_notAfter(cert), 24*3600);
+			X509_set_pubkey(cert, key);
+			auto subject = X509_get_subject_name(cert);
+			X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>(name), -1, -1, 0);
+			X509_set_issuer_name(cert, issuer ? X509_get_subject_name(issuer) : subject);
+
+			X509V3_CTX v3;
+			X509V3_set_ctx(&v3, issuer ? issuer : cert, cert, nullptr, nullptr, 0);
+			auto extend = [&](int nid, const char *value) {
+				auto ext = X509V3_EXT_conf_nid(nullptr, &v3, nid, value);
+				X509_add_ext(cert, ext, -1);
+				X509_EXTENSION_free(ext);
+			};
+			if (issuer == nullptr) {
+				extend(NID_basic_constraints, "critical,CA:TRUE");
+				extend(NID_key_usage, "critical,keyCertSign,cRLSign");
+			}
+			else {
+				extend(NID_basic_constraints, "critical,CA:FALSE");
+				extend(NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1");
+			}
+			X509_sign(cert, signer, EVP_sha256());
+			return cert;
+		}
+
+		void _run()
+		{
+			int s;
+			while ((s = accept(_listener, nullptr, nullptr)) >= 0) {
+				auto ssl = SSL_new(_ctx);
+				SSL_set_fd(ssl, s);
+
+				// Early data has to be read before the handshake can complete
+				std::string early;
+				if (_earlydata > 0) {
+					char buffer[16*1024];
+					size_t n;
+					int ret;
+					while ((ret = SSL_read_early_data(ssl, buffer, sizeof(buffer), &n)) == SSL_READ_EARLY_DATA_SUCCESS)
+						early.append(buffer, n);
+					if (ret == SSL_READ_EARLY_DATA_ERROR)
+						early.clear();
+				}
+
+				if (SSL_accept(ssl) == 1) {
+					_handshakes++;
+					if (SSL_session_reused(ssl))
+						_resumed++;
+					if (SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED)
+						_earlyaccepted++;
+					_handler(ssl, early);
+				}
+				ERR_clear_error();
+				SSL_free(ssl);
+				close(s);
+			}
+		}
+
+		handler_t _handler;
+
+		uint32_t _earlydata;
+
+		SSL_CTX *_ctx;
+
+		int _listener;
+
+		std::string _port;
+
+		std::string _ca;
+
+		std::atomic<uint64_t> _handshakes = 0;
+
+		std::atomic<uint64_t> _resumed = 0;
+
+		std::atomic<uint64_t> _earlyaccepted = 0;
+
+		std::thread _thread;
+	};
+
+	inline tlsserver::options::options()
+	{
+	}
+}
\ No newline at end of file
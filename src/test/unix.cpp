@@ -0,0 +1,87 @@
+#include "../inet/unix/unixclient.hpp"
+#include "check.hpp"
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace inet;
+
+// Listens on the path (a leading '@' is the abstract namespace) and echoes one connection
+static int listen_on(const std::string& path)
+{
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	std::memcpy(addr.sun_path, path.data(), path.size());
+	if (path[0] == '@')
+		addr.sun_path[0] = '\0';
+	bind(s, reinterpret_cast<sockaddr*>(&addr), offsetof(sockaddr_un, sun_path)+path.size()+(path[0] == '@' ? 0 : 1));
+	listen(s, 1);
+	return s;
+}
+
+static void echo(int listener)
+{
+	int s = accept(listener, nullptr, nullptr);
+	char buffer[4096];
+	ssize_t n;
+	while ((n = recv(s, buffer, sizeof(buffer), 0)) > 0)
+		send(s, buffer, n, MSG_NOSIGNAL);
+	close(s);
+}
+
+static void roundtrip(const std::string& path)
+{
+	int listener = listen_on(path);
+	std::thread server(echo, listener);
+
+	unix::client c;
+	c.open(path);
+	CHECK(c.is_open());
+	CHECK(std::strcmp(c.getprotocol(), "UNIX") == 0);
+	c.enable_timeout(5000);
+	for (int i = 0; i < 100; i++) {
+		std::string line;
+		c << "message " << i << '\n' << std::flush;
+		std::getline(c, line);
+		CHECK(line == "message " + std::to_string(i));
+	}
+
+	// A message larger than the stream buffer has to come back whole (small enough to fit the socket buffers, the
+	// echo only reads while it can write)
+	std::string big(64*1024, 'u');
+	c.write(big.data(), big.size());
+	c.flush();
+	std::string back(big.size(), '\0');
+	c.read(back.data(), back.size());
+	CHECK(back == big);
+
+	c.close();
+	CHECK(!c.is_open());
+	server.join();
+	close(listener);
+}
+
+int main()
+{
+	std::string path = "/tmp/inet-test-" + std::to_string(getpid()) + ".sock";
+	roundtrip(path);
+	unlink(path.c_str());
+	roundtrip("@inet-test-" + std::to_string(getpid()));
+
+	// Nobody listens here
+	unix::client c;
+	bool failed = false;
+	try {
+		c.open("/tmp/inet-test-missing.sock");
+	}
+	catch (const std::exception&) {
+		failed = true;
+	}
+	CHECK(failed || !c.is_open());
+	return test::result("unix");
+}
\ No newline at end of file